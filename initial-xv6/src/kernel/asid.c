@@ -0,0 +1,137 @@
+//
+// Address-space identifiers (ASIDs).
+//
+// Each process runs in user space with an ASID of its own in
+// satp, and the kernel with ASID 0, so the TLB can hold the
+// translations of several address spaces at once: a trap, a
+// return to user space or a context switch needs no flush.
+//
+// ASIDs are handed out in order. When they run out, a new
+// generation starts: a process with an ASID from an older one
+// gets a new ASID the next time it returns to user space, and
+// each hart flushes its whole TLB before it first runs a
+// process with an ASID of the new generation.
+//
+// A process's translations may be in the TLB of any hart it
+// has run on. A hart flushes the process's ASID when the
+// process comes back to it from another hart, since the page
+// table may have changed meanwhile. Changes on the hart the
+// process last ran on in user space are flushed by tlbflush(),
+// page by page, or by tlbstale(), which has usertrapret() flush
+// the whole ASID.
+//
+// Without hardware ASIDs (or with ASID=0), every process has
+// ASID 0, and trampoline.S flushes the TLB on each trap and
+// return to user space instead.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "vmstat.h"
+#include "defs.h"
+
+extern struct vmstat vmstat;
+extern pagetable_t kernel_pagetable;
+
+static struct spinlock asidlock;
+static uint64 maxasid;          // largest the hardware takes; 0 if none
+static uint64 generation = 1;   // of ASIDs now being handed out
+static uint64 nextasid = 1;
+
+// Find how many ASID bits satp has: they are the ones that
+// keep a 1 written to them. Call after kvminithart().
+void
+asidinit(void)
+{
+  initlock(&asidlock, "asid");
+#ifndef NOASID
+  w_satp(MAKE_SATP(kernel_pagetable, SATP_ASIDMASK));
+  maxasid = SATP_ASID(r_satp());
+  w_satp(MAKE_SATP(kernel_pagetable, 0));
+  sfence_vma();
+#endif
+}
+
+// The satp value for p to return to user space with, after
+// flushing whatever this hart's TLB may hold for p that is
+// out of date. Called by usertrapret(), and by copyin() and
+// copyout() to reach p's memory, with interrupts off.
+uint64
+asidsatp(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int fresh = 0, flushall = 0;
+
+  if(maxasid == 0)
+    return MAKE_SATP(p->pagetable, 0);
+
+  // the usual case, which copyin() and copyout() hit too, needs
+  // no lock: p's ASID and this hart's TLB are of the current
+  // generation, and only a rollover, under the lock, changes it.
+  if(p->asidgen != c->asidgen ||
+     c->asidgen != __atomic_load_n(&generation, __ATOMIC_ACQUIRE)){
+    acquire(&asidlock);
+    if(p->asidgen != generation){
+      if(nextasid > maxasid){
+        __atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+        nextasid = 1;
+        __atomic_fetch_add(&vmstat.asidroll, 1, __ATOMIC_RELAXED);
+      }
+      p->asid = nextasid++;
+      p->asidgen = generation;
+      fresh = 1;
+    }
+    if(c->asidgen != generation){
+      c->asidgen = generation;
+      flushall = 1;
+    }
+    release(&asidlock);
+  }
+
+  if(flushall){
+    sfence_vma();
+    __atomic_fetch_add(&vmstat.flushall, 1, __ATOMIC_RELAXED);
+  } else if(!fresh && (p->tlbstale || p->tlbcpu != c)){
+    sfence_vma_asid(p->asid);
+    __atomic_fetch_add(&vmstat.asidflush, 1, __ATOMIC_RELAXED);
+  }
+  p->tlbstale = 0;
+  p->tlbcpu = c;
+  return MAKE_SATP(p->pagetable, p->asid);
+}
+
+// Many of pagetable's PTEs have changed. If it is the current
+// process's, flush its ASID before it is next in user space.
+// A new page table needs nothing; evict() in swap.c marks the
+// process whose page it takes itself.
+void
+tlbstale(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    p->tlbstale = 1;
+}
+
+// pagetable's PTE for va has changed. If it is the current
+// process's, flush that page now, if this hart was the last to
+// run the process in user space; if not, each hart flushes the
+// whole ASID before it next runs the process there.
+void
+tlbflush(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pagetable != pagetable)
+    return;
+  push_off();
+  if(p->tlbcpu == mycpu())
+    sfence_vma_page(va, p->asid);
+  else
+    p->tlbstale = 1;
+  pop_off();
+}
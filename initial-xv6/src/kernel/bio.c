@@ -17,14 +17,18 @@
 #include "types.h"
 #include "param.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
 
+// bcache.lock is a reader-writer lock. Cache hits hold it for
+// reading and only change b->refcnt, atomically; recycling a
+// buffer or reordering the LRU list holds it for writing.
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct buf buf[NBUF];
 
   // Linked list of all buffers, through prev/next.
@@ -38,7 +42,7 @@ binit(void)
 {
   struct buf *b;
 
-  initlock(&bcache.lock, "bcache");
+  initrwlock(&bcache.lock, "bcache");
 
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
@@ -60,13 +64,25 @@ bget(uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
   // Is the block already cached?
+  acquireread(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_RELAXED);
+      releaseread(&bcache.lock);
+      acquiresleep(&b->lock);
+      return b;
+    }
+  }
+  releaseread(&bcache.lock);
+
+  // Check again with the lock held for writing,
+  // in case another hart cached it meanwhile.
+  acquirewrite(&bcache.lock);
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
+      releasewrite(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
@@ -80,7 +96,7 @@ bget(uint dev, uint blockno)
       b->blockno = blockno;
       b->valid = 0;
       b->refcnt = 1;
-      release(&bcache.lock);
+      releasewrite(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
@@ -121,8 +137,14 @@ brelse(struct buf *b)
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
-  b->refcnt--;
+  acquireread(&bcache.lock);
+  if (__atomic_sub_fetch(&b->refcnt, 1, __ATOMIC_RELAXED) != 0) {
+    releaseread(&bcache.lock);
+    return;
+  }
+  releaseread(&bcache.lock);
+
+  acquirewrite(&bcache.lock);
   if (b->refcnt == 0) {
     // no one is waiting for it.
     b->next->prev = b->prev;
@@ -133,21 +155,21 @@ brelse(struct buf *b)
     bcache.head.next = b;
   }
   
-  release(&bcache.lock);
+  releasewrite(&bcache.lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt++;
-  release(&bcache.lock);
+  acquireread(&bcache.lock);
+  __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_RELAXED);
+  releaseread(&bcache.lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt--;
-  release(&bcache.lock);
+  acquireread(&bcache.lock);
+  __atomic_fetch_sub(&b->refcnt, 1, __ATOMIC_RELAXED);
+  releaseread(&bcache.lock);
 }
 
 
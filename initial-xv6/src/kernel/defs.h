@@ -1,11 +1,15 @@
 struct buf;
 struct context;
 struct file;
+struct fpstate;
+struct vecstate;
 struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct rwlock;
+struct shm;
 struct stat;
 struct superblock;
 
@@ -25,6 +29,11 @@ void            consputc(int);
 // exec.c
 int             exec(char*, char**);
 
+// fdt.c
+void            fdtinit(uint64);
+extern int      ncpu;
+extern uint64   phystop;
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
@@ -38,6 +47,7 @@ int             filewrite(struct file*, uint64, int n);
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dcachedel(struct inode*, char*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -50,6 +60,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+uint64          readpage(struct inode*, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -63,6 +74,76 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kalloc_zeroed(void);
+void            kzeroidle(void);
+void*           bootalloc(uint64);
+void*           alloc_pages(int);
+void            free_pages(void*, int);
+uint64          nfree_pages(int);
+uint64          kfreepages(void);
+void            krefinc(void*);
+int             krefget(void*);
+
+// lockstat.c
+struct lockcount;
+void            lockstatinit(void);
+int             lockclass(char*, int, int);
+struct lockcount* mylockcount(int);
+int             lockstatread(uint64, int);
+void            lockstatreset(void);
+
+// kmalloc.c
+void            kmallocinit(void);
+void*           kmalloc(uint64);
+void            kfree_obj(void*);
+
+// mmap.c
+uint64          mmapbase(struct proc*);
+uint64          mmap(uint64, int, int, struct file*, uint64);
+uint64          mmapfault(struct proc*, uint64, int);
+int             mmapwrite(struct proc*, uint64, pte_t*);
+int             munmap(uint64, uint64);
+void            mmapexit(struct proc*);
+int             mmapfork(struct proc*, struct proc*);
+uint64          mmapshm(struct shm*, uint64);
+
+// lz.c
+int             lzcompress(char*, int, char*, int);
+int             lzdecompress(char*, int, char*, int);
+
+// pcache.c
+void            pcacheinit(void);
+uint64          pcachefind(struct inode*, uint);
+void            pcacheadd(struct inode*, uint, void*);
+void            pcacheupdate(struct inode*, uint, char*, uint);
+void            pcachedrop(struct inode*);
+int             pcacheshrink(int);
+
+// asid.c
+void            asidinit(void);
+uint64          asidsatp(struct proc*);
+void            tlbstale(pagetable_t);
+void            tlbflush(pagetable_t, uint64);
+
+// swap.c
+void            swapinit(void);
+void            rmapset(void*, struct proc*, uint64);
+void            swapfree(pte_t);
+int             swapfork(pagetable_t, uint64, pte_t);
+int             swapreclaim(int);
+void            swapcheck(void);
+uint64          swapin(pagetable_t, uint64, pte_t*);
+
+// shm.c
+void            shminit(void);
+int             shmopen(int, uint64);
+uint64          shmattach(int);
+int             shmdetach(uint64);
+int             shmclose(int);
+void            shmexit(struct proc*);
+void            shmdup(struct shm*);
+void            shmput(struct shm*);
+uint64          shmpage(struct shm*, int);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -71,6 +152,7 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -82,6 +164,7 @@ void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
 // proc.c
+void            cpuinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
@@ -102,6 +185,7 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeproc(struct proc*, void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -111,20 +195,40 @@ uint64          set_priority_proc(int , int);
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// fpu.S
+void            fpsave(struct fpstate*);
+void            fprestore(struct fpstate*);
+void            vecsave(struct vecstate*);
+void            vecrestore(struct vecstate*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlockid(struct spinlock*, char*, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// start.c
+extern int      hasrvv;
+extern uint64   bootdtb;
+uint64          bootpage(int);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -148,6 +252,9 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            fpusave(struct proc*);
+void            vecusave(struct proc*);
+extern uint64   vlenb;
 int             pagefault(uint64, pte_t*, pagetable_t);
 
 // uart.c
@@ -166,15 +273,21 @@ pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
+uint64          uvmlazy(pagetable_t, uint64, int);
+int             uvmsplit(pagetable_t, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+void            uvmprefault(uint64, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
+pte_t *         leafpte(pagetable_t, uint64, int*);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            kwinmap(pagetable_t);
+void            kwinunmap(pagetable_t);
 
 // plic.c
 void            plicinit(void);
@@ -193,6 +306,7 @@ void            update_time(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
-#define PAGE_COUNT PGROUNDUP(PHYSTOP) >> 12
+#define PAGE_COUNT ((phystop - KERNBASE) >> 12)
+#define PAGE_INDEX(pa) (((uint64)(pa) - KERNBASE) >> 12)
 #define COW
 
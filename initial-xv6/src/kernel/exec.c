@@ -7,7 +7,7 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+static int loadseg(pde_t *, uint64, struct inode *, uint, uint, int);
 
 int flags2perm(int flags)
 {
@@ -61,11 +61,11 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
-      goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    // map only the pages with file contents; the
+    // rest (the bss) is zero-filled on first touch.
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
+    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz, flags2perm(ph.flags)) < 0)
       goto bad;
   }
   iunlockput(ip);
@@ -120,14 +120,32 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // the old image's mmap()ed regions go with it.
+  mmapexit(p);
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  // the TLB may hold the old image's pages under p's ASID.
+  p->tlbstale = 1;
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
 
+  // the new image starts with the FPU and vector unit off and
+  // zeroed f registers; the v registers page is freed.
+  p->fpused = 0;
+  p->fpdirty = 0;
+  p->fpcpu = 0;
+  memset(&p->fpstate, 0, sizeof(p->fpstate));
+  if (p->vecstate.regs)
+    kfree(p->vecstate.regs);
+  p->vecused = 0;
+  p->vecdirty = 0;
+  p->veccpu = 0;
+  memset(&p->vecstate, 0, sizeof(p->vecstate));
+
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -140,26 +158,36 @@ exec(char *path, char **argv)
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
+// Load a program segment into pagetable at virtual address va,
+// which must be page-aligned, with permissions perm.
+// Every page is a copy, read through the page cache: the
+// cache's own pages change whenever the file is written, which
+// must not change programs already running it.
 // Returns 0 on success, -1 on failure.
 static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz, int perm)
 {
   uint i, n;
-  uint64 pa;
+  pte_t *pte;
+  char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
+    if((pte = walk(pagetable, va + i, 0)) != 0 && (*pte & PTE_V))
+      return -1;
     if(sz - i < PGSIZE)
       n = sz - i;
     else
       n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
+
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    if(readi(ip, 0, (uint64)mem, offset+i, n) != n ||
+       mappages(pagetable, va + i, PGSIZE, (uint64)mem, PTE_R|PTE_U|perm) != 0){
+      kfree(mem);
       return -1;
+    }
+    // for swapping, once the new image is committed.
+    rmapset(mem, myproc(), va + i);
   }
   
   return 0;
@@ -0,0 +1,146 @@
+//
+// a minimal reader for the flattened device tree (DTB)
+// that qemu passes in a1 at boot. fdtinit() pulls out
+// the number of harts and the size of RAM; nothing else
+// in the tree is used.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+// all fields are big-endian.
+struct fdt_header {
+  uint32 magic;
+  uint32 totalsize;
+  uint32 off_dt_struct;
+  uint32 off_dt_strings;
+  uint32 off_mem_rsvmap;
+  uint32 version;
+  uint32 last_comp_version;
+  uint32 boot_cpuid_phys;
+  uint32 size_dt_strings;
+  uint32 size_dt_struct;
+};
+
+int ncpu;        // number of harts: the largest hartid + 1.
+uint64 phystop;  // end of the RAM the kernel uses.
+
+static uint32
+be32(void *p)
+{
+  uchar *b = p;
+
+  return ((uint32)b[0] << 24) | ((uint32)b[1] << 16) | ((uint32)b[2] << 8) | b[3];
+}
+
+// a number spread over cells 32-bit words, most significant first.
+static uint64
+cells(uint32 *p, int n)
+{
+  uint64 x = 0;
+
+  for(int i = 0; i < n; i++)
+    x = (x << 32) | be32(p + i);
+  return x;
+}
+
+static int
+isname(char *s, char *name)
+{
+  return strncmp(s, name, strlen(name) + 1) == 0;
+}
+
+static int
+hasprefix(char *s, char *prefix)
+{
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// find the harts and RAM described by the device tree at dtb.
+// without a device tree, assume NCPU harts and PHYSTOP.
+// runs on hart 0 before paging and before anything is printed.
+void
+fdtinit(uint64 dtb)
+{
+  struct fdt_header *h = (struct fdt_header *)dtb;
+  int depth = 0;
+  int incpus = 0, incpu = 0, inmem = 0;
+  int acells = 2, scells = 1;   // the root's #address-cells, #size-cells
+  int cpucells = 1;             // /cpus's #address-cells
+  int maxhart = -1;
+  uint64 ramend = 0;
+
+  ncpu = NCPU;
+  phystop = PHYSTOP;
+  if(dtb == 0 || be32(&h->magic) != FDT_MAGIC)
+    return;
+
+  char *strings = (char *)dtb + be32(&h->off_dt_strings);
+  uint32 *p = (uint32 *)(dtb + be32(&h->off_dt_struct));
+
+  for(;;){
+    uint32 tok = be32(p++);
+
+    if(tok == FDT_BEGIN_NODE){
+      char *name = (char *)p;
+      depth++;
+      if(depth == 2){
+        incpus = isname(name, "cpus");
+        inmem = hasprefix(name, "memory");
+      } else if(depth == 3 && incpus){
+        incpu = hasprefix(name, "cpu@");
+      }
+      p += (strlen(name) + 4) / 4;   // the name, its 0, padding
+    } else if(tok == FDT_END_NODE){
+      if(depth == 3)
+        incpu = 0;
+      else if(depth == 2)
+        incpus = inmem = 0;
+      depth--;
+    } else if(tok == FDT_PROP){
+      uint32 len = be32(p);
+      char *pname = strings + be32(p + 1);
+      uint32 *val = p + 2;
+      p += 2 + (len + 3) / 4;
+
+      if(depth == 1 && isname(pname, "#address-cells")){
+        acells = be32(val);
+      } else if(depth == 1 && isname(pname, "#size-cells")){
+        scells = be32(val);
+      } else if(incpus && depth == 2 && isname(pname, "#address-cells")){
+        cpucells = be32(val);
+      } else if(incpu && depth == 3 && isname(pname, "reg")){
+        int hart = cells(val, cpucells);
+        if(hart > maxhart)
+          maxhart = hart;
+      } else if(inmem && depth == 2 && isname(pname, "reg")){
+        // (address, size) pairs; keep the bank the kernel is in.
+        for(int i = 0; i + acells + scells <= len / 4; i += acells + scells){
+          uint64 base = cells(val + i, acells);
+          uint64 size = cells(val + i + acells, scells);
+          if(base <= KERNBASE && KERNBASE < base + size)
+            ramend = base + size;
+        }
+      }
+    } else if(tok == FDT_NOP){
+      // skip
+    } else {
+      break;  // FDT_END, or a corrupt tree
+    }
+  }
+
+  if(maxhart >= 0)
+    ncpu = maxhart + 1;
+  if(ramend > KERNBASE)
+    phystop = ramend < PHYSTOP_MAX ? ramend : PHYSTOP_MAX;
+}
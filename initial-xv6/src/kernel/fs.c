@@ -15,6 +15,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -164,26 +165,34 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// The itable.lock reader-writer lock protects the allocation of
+// itable entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
+// Lookups (iget hits, idup) hold it for reading and may only
+// increment ip->ref, atomically; anything that can drop ref to
+// zero or reassign an entry holds it for writing. So concurrent
+// lookups from several harts don't serialize.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct inode inode[NINODE];
 } itable;
 
+static void dcacheinit(void);
+static void dcacheforget(uint dev, uint inum);
+
 void
 iinit()
 {
   int i = 0;
   
-  initlock(&itable.lock, "itable");
+  initrwlock(&itable.lock, "itable");
+  dcacheinit();
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
@@ -248,14 +257,25 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&itable.lock);
-
   // Is the inode already in the table?
+  acquireread(&itable.lock);
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
+      releaseread(&itable.lock);
+      return ip;
+    }
+  }
+  releaseread(&itable.lock);
+
+  // Not there; look again, since another hart may have
+  // added it meanwhile, and otherwise claim a free slot.
+  acquirewrite(&itable.lock);
   empty = 0;
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&itable.lock);
+      releasewrite(&itable.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
@@ -271,7 +291,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  releasewrite(&itable.lock);
 
   return ip;
 }
@@ -281,9 +301,9 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  acquireread(&itable.lock);
+  __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
+  releaseread(&itable.lock);
   return ip;
 }
 
@@ -336,7 +356,7 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  acquirewrite(&itable.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -345,20 +365,23 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    releasewrite(&itable.lock);
 
     itrunc(ip);
     ip->type = 0;
+    // before iupdate() frees the inode for ialloc() to reuse,
+    // so no lookup finds the old name for the new file.
+    dcacheforget(ip->dev, ip->inum);
     iupdate(ip);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquirewrite(&itable.lock);
   }
 
   ip->ref--;
-  release(&itable.lock);
+  releasewrite(&itable.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -429,6 +452,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcachedrop(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -464,21 +488,14 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
-// Read data from inode.
-// Caller must hold ip->lock.
-// If user_dst==1, then dst is a user virtual address;
-// otherwise, dst is a kernel address.
-int
-readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+// Read data from a directory, or from a file the page cache
+// had no memory for, a block at a time.
+static int
+readblocks(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
 
-  if(off > ip->size || off + n < off)
-    return 0;
-  if(off + n > ip->size)
-    n = ip->size - off;
-
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -495,6 +512,72 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Return page pgno of ip's data from the page cache, reading
+// it in if it isn't there; past the end of the file, the page
+// is zero. The caller must kfree() the page when done with it.
+// Returns 0 if out of memory.
+// Caller must hold ip->lock.
+uint64
+readpage(struct inode *ip, uint pgno)
+{
+  uint64 pa;
+  char *mem;
+  struct buf *bp;
+
+  if((pa = pcachefind(ip, pgno)) != 0)
+    return pa;
+  if((mem = kalloc()) == 0)
+    return 0;
+  for(int i = 0; i < PGSIZE/BSIZE; i++){
+    uint off = pgno*PGSIZE + i*BSIZE;
+    uint addr;
+    if(off >= ip->size || (addr = bmap(ip, off/BSIZE)) == 0){
+      memset(mem + i*BSIZE, 0, BSIZE);
+      continue;
+    }
+    // through the buffer cache, which has any of the file's
+    // blocks that the log hasn't yet written home.
+    bp = bread(ip->dev, addr);
+    memmove(mem + i*BSIZE, bp->data, BSIZE);
+    brelse(bp);
+  }
+  pcacheadd(ip, pgno, mem);
+  return (uint64)mem;
+}
+
+// Read data from inode.
+// Caller must hold ip->lock.
+// If user_dst==1, then dst is a user virtual address;
+// otherwise, dst is a kernel address.
+int
+readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  uint64 pa;
+  int r;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  if(ip->type != T_FILE)
+    return readblocks(ip, user_dst, dst, off, n);
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pa = readpage(ip, off/PGSIZE)) == 0){
+      if((r = readblocks(ip, user_dst, dst, off, m)) != m)
+        return r < 0 ? -1 : tot + r;
+      continue;
+    }
+    r = either_copyout(user_dst, dst, (char *)pa + off%PGSIZE, m);
+    kfree((void *)pa);
+    if(r == -1)
+      return -1;
+  }
+  return tot;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -524,6 +607,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       break;
     }
     log_write(bp);
+    if(ip->type == T_FILE)
+      pcacheupdate(ip, off, (char *)bp->data + (off % BSIZE), m);
     brelse(bp);
   }
 
@@ -546,6 +631,130 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory entry cache, for namei()'s lockless fast path.
+//
+// Remembers (dev, directory inum, name) -> inum for entries that
+// dirlookup() has found. Readers take no locks: each slot has a
+// sequence counter that a writer, holding dcache.lock, makes odd
+// while it changes the slot, and a reader checks it before and
+// after copying the slot out, giving up if it moved. Only names
+// that exist are cached; unlink removes a name, and freeing an
+// inode drops every entry in or pointing at it.
+
+#define NDCACHE 256
+
+struct dentry {
+  uint seq;
+  uint dev;
+  uint dir;          // the directory's inum; 0 if the slot is empty
+  uint inum;
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry e[NDCACHE];
+} dcache;
+
+static void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dslot(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.e[h % NDCACHE];
+}
+
+// Returns name's inum in directory dir, or 0 if it isn't
+// cached or a writer got in the way.
+static uint
+dcacheget(uint dev, uint dir, char *name)
+{
+  struct dentry *d = dslot(dev, dir, name);
+  uint seq, inum = 0;
+
+  seq = __atomic_load_n(&d->seq, __ATOMIC_ACQUIRE);
+  if(seq & 1)
+    return 0;
+  if(d->dir == dir && d->dev == dev && namecmp(name, d->name) == 0)
+    inum = d->inum;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(__atomic_load_n(&d->seq, __ATOMIC_RELAXED) != seq)
+    return 0;
+  return inum;
+}
+
+// Start and finish changing a slot. dcache.lock must be held.
+static void
+dbegin(struct dentry *d)
+{
+  __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+dend(struct dentry *d)
+{
+  __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void
+dcacheput(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d = dslot(dev, dir, name);
+
+  acquire(&dcache.lock);
+  if(d->dir != dir || d->dev != dev || d->inum != inum || namecmp(name, d->name) != 0){
+    dbegin(d);
+    d->dev = dev;
+    d->dir = dir;
+    d->inum = inum;
+    strncpy(d->name, name, DIRSIZ);
+    dend(d);
+  }
+  release(&dcache.lock);
+}
+
+// Forget name in directory dp, which is about to lose it.
+void
+dcachedel(struct inode *dp, char *name)
+{
+  struct dentry *d = dslot(dp->dev, dp->inum, name);
+
+  acquire(&dcache.lock);
+  if(d->dir == dp->inum && d->dev == dp->dev && namecmp(name, d->name) == 0){
+    dbegin(d);
+    d->dir = 0;
+    dend(d);
+  }
+  release(&dcache.lock);
+}
+
+// Forget everything about inode inum, which has been freed
+// and may come back as a different file or directory.
+static void
+dcacheforget(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.e; d < &dcache.e[NDCACHE]; d++){
+    if(d->dir != 0 && d->dev == dev && (d->dir == inum || d->inum == inum)){
+      dbegin(d);
+      d->dir = 0;
+      dend(d);
+    }
+  }
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -567,6 +776,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcacheput(dp->dev, dp->inum, name, inum);
       return iget(dp->dev, inum);
     }
   }
@@ -683,10 +893,50 @@ namex(char *path, int nameiparent, char *name)
   return ip;
 }
 
+// namei()'s fast path: walk path through the directory entry
+// cache alone, taking no inode sleeplocks and reading no
+// directory blocks. Returns 0 if any element isn't cached.
+// Only the final inode is referenced; re-checking its entry
+// afterwards makes sure it wasn't unlinked (and perhaps freed)
+// before iget() took the reference.
+static struct inode*
+namefast(char *path)
+{
+  char name[DIRSIZ];
+  uint dev, dir, inum;
+  struct inode *ip;
+
+  if(*path == '/'){
+    dev = ROOTDEV;
+    inum = ROOTINO;
+  } else {
+    dev = myproc()->cwd->dev;
+    inum = myproc()->cwd->inum;
+  }
+
+  dir = 0;
+  while((path = skipelem(path, name)) != 0){
+    dir = inum;
+    if((inum = dcacheget(dev, dir, name)) == 0)
+      return 0;
+  }
+
+  ip = iget(dev, inum);
+  if(dir != 0 && dcacheget(dev, dir, name) != inum){
+    iput(ip);
+    return 0;
+  }
+  return ip;
+}
+
 struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
+  struct inode *ip;
+
+  if((ip = namefast(path)) != 0)
+    return ip;
   return namex(path, 0, name);
 }
 
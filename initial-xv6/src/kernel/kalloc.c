@@ -1,6 +1,26 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages
+// with kalloc(), or runs of 2^order contiguous pages
+// with alloc_pages().
+//
+// Free memory is kept by a buddy allocator: blocks of 2^k
+// pages, k = 0..MAXORDER, each aligned to its own size counted
+// from KERNBASE. Allocation splits the smallest big-enough
+// block; freeing merges a block with its buddy (the other half
+// of the next larger block) for as long as the buddy is free.
+//
+// Each hart keeps a small cache ("magazine") of free single
+// pages in its struct cpu, so most kalloc() and kfree() calls
+// only take that hart's own lock. The cache is refilled from
+// and drained to the buddy allocator PCBATCH pages at a time; a
+// hart that finds both empty takes a page from another hart's
+// cache.
+//
+// Harts with nothing to run zero free pages into a small pool,
+// from which kalloc_zeroed() hands out pages that need no
+// clearing. Freed and newly allocated pages are filled with
+// junk only in debug builds (make DEBUG=1).
 
 #include "types.h"
 #include "param.h"
@@ -11,6 +31,10 @@
 #include "proc.h"
 
 void freerange(void *pa_start, void *pa_end);
+static void refill(struct cpu *c);
+static void drain(struct cpu *c);
+static struct run *steal(void);
+static struct run *cachepop(void);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
@@ -20,38 +44,81 @@ struct run
   struct run *next;
 };
 
+// a free buddy block, on its order's circular list.
+struct block
+{
+  struct block *next;
+  struct block *prev;
+};
+
 struct
 {
   struct spinlock lock;
-  struct run *freelist;
+  struct block free[MAXORDER + 1]; // list heads, by order
+  uint64 nfree[MAXORDER + 1];      // blocks on each list
+  uchar *order;                    // per page: k+1 if a free order-k
+                                   // block starts there, else 0
 } kmem;
 
+#define PCPAGES 64  // most pages a hart's cache holds
+#define PCBATCH 32  // pages moved to or from kmem at once
+
+#define ZPOOLMAX 256 // most pre-zeroed pages kept
+#define ZBATCH   4   // pages an idle hart zeroes at a time
+
+// free pages already zeroed, for kalloc_zeroed().
+struct
+{
+  struct spinlock lock;
+  struct run *free;
+  int n;
+} zpool;
+
 #ifdef COW
-struct cow_info page_details[PAGE_COUNT];
-struct spinlock page_cow_lock;
+// per page, by PAGE_INDEX(): how many page tables map it (or
+// 1 for a page the kernel holds). Changed only with atomic
+// adds and stores, so it needs no lock.
+static int *refcnt;
 #endif
 
-void kinit()
+// next free byte for bootalloc(); past the harts' boot pages.
+static char *bootfree;
+
+// Allocate n zeroed bytes that are never freed, for tables whose
+// size depends on the hardware (per-CPU state, per-page data).
+// Only before kinit() hands the remaining memory to kalloc().
+void *
+bootalloc(uint64 n)
 {
+  char *p;
 
-  // printf("here\n");
+  if (bootfree == 0)
+    bootfree = (char *)bootpage(ncpu);
+  p = bootfree;
+  bootfree += (n + 15) & ~15L;
+  if ((uint64)bootfree > phystop)
+    panic("bootalloc");
+  memset(p, 0, n);
+  return p;
+}
+
+void kinit()
+{
 #ifdef COW
-  initlock(&page_cow_lock, "page_cow");
-  // printf("here\n");
-  acquire(&page_cow_lock);
-  // printf("here\n");
+  // one reference each, for freerange() to drop.
+  refcnt = bootalloc(PAGE_COUNT * sizeof(int));
   for (int i = 0; i < PAGE_COUNT; i++)
-  {
-    page_details[i].numReferences = 1;
-    page_details[i].page_number = i;
-    page_details[i].p = 0;
-  }
-  // printf("here\n");
-  release(&page_cow_lock);
-
+    refcnt[i] = 1;
 #endif
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void *)PHYSTOP);
+  initlock(&zpool.lock, "zpool");
+  for (int k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  kmem.order = bootalloc(PAGE_COUNT);
+  for (int i = 0; i < ncpu; i++)
+    initlock(&cpus[i].kmemlock, "kmem_cpu");
+  // the device tree, near the top of RAM, is no longer needed.
+  freerange(bootalloc(0), (void *)phystop);
 }
 
 void freerange(void *pa_start, void *pa_end)
@@ -70,36 +137,194 @@ void kfree(void *pa)
 {
   struct run *r;
 
-  if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP)
+  if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= phystop)
     panic("kfree");
 
 #ifdef COW
-  acquire(&page_cow_lock);
-  int page_num = ((uint64)pa / PGSIZE);
-  if (page_details[page_num].numReferences <= 0)
-  {
+  int n = __atomic_sub_fetch(&refcnt[PAGE_INDEX(pa)], 1, __ATOMIC_ACQ_REL);
+  if (n < 0)
     panic("kfree: no references");
-  }
-  page_details[page_num].numReferences--;
-
-  if (page_details[page_num].numReferences > 0)
-  {
-    release(&page_cow_lock);
+  if (n > 0)
     return;
-  }
-  release(&page_cow_lock);
 #endif
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
+  // no process maps it now.
+  rmapset(pa, 0, 0);
 
   r = (struct run *)pa;
 
+  push_off();
+  struct cpu *c = mycpu();
+  acquire(&c->kmemlock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  if (c->nfree > PCPAGES)
+    drain(c);
+  release(&c->kmemlock);
+  pop_off();
+}
+
+static void
+bpush(int k, struct block *b)
+{
+  struct block *h = &kmem.free[k];
+
+  b->next = h->next;
+  b->prev = h;
+  h->next->prev = b;
+  h->next = b;
+  kmem.nfree[k]++;
+  kmem.order[PAGE_INDEX(b)] = k + 1;
+}
+
+static void
+bremove(int k, struct block *b)
+{
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  kmem.nfree[k]--;
+  kmem.order[PAGE_INDEX(b)] = 0;
+}
+
+// Take a free block of 2^order pages, splitting a larger
+// one if need be. kmem.lock must be held.
+static void *
+buddyalloc(int order)
+{
+  struct block *b;
+  int k;
+
+  for (k = order; k <= MAXORDER && kmem.free[k].next == &kmem.free[k]; k++)
+    ;
+  if (k > MAXORDER)
+    return 0;
+  b = kmem.free[k].next;
+  bremove(k, b);
+  // give back the upper half until b is the right size.
+  while (k > order)
+  {
+    k--;
+    bpush(k, (struct block *)((char *)b + (PGSIZE << k)));
+  }
+  return b;
+}
+
+// Give back a block of 2^order pages, merging it with its
+// buddy while that is free. kmem.lock must be held.
+static void
+buddyfree(void *pa, int order)
+{
+  uint64 i = PAGE_INDEX(pa);
+
+  while (order < MAXORDER)
+  {
+    uint64 buddy = i ^ (1L << order);
+    if (buddy >= PAGE_COUNT || kmem.order[buddy] != order + 1)
+      break;
+    bremove(order, (struct block *)(KERNBASE + buddy * PGSIZE));
+    i &= ~(1L << order);
+    order++;
+  }
+  bpush(order, (struct block *)(KERNBASE + i * PGSIZE));
+}
+
+// Move PCBATCH pages from the buddy allocator to c's cache.
+// c->kmemlock must be held.
+static void
+refill(struct cpu *c)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for (int i = 0; i < PCBATCH && (r = buddyalloc(0)) != 0; i++)
+  {
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Move PCBATCH pages from c's cache back to the buddy allocator.
+// c->kmemlock must be held.
+static void
+drain(struct cpu *c)
+{
+  struct run *r;
+
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  for (int i = 0; i < PCBATCH && (r = c->freelist) != 0; i++)
+  {
+    c->freelist = r->next;
+    c->nfree--;
+    buddyfree(r, 0);
+  }
   release(&kmem.lock);
 }
 
+// kmem is empty too: take a page from another hart's cache.
+static struct run *
+steal(void)
+{
+  struct run *r = 0;
+
+  for (int i = 0; i < ncpu && r == 0; i++)
+  {
+    struct cpu *c = &cpus[i];
+    acquire(&c->kmemlock);
+    if ((r = c->freelist) != 0)
+    {
+      c->freelist = r->next;
+      c->nfree--;
+    }
+    release(&c->kmemlock);
+  }
+  return r;
+}
+
+// Take a page from this hart's cache, refilling
+// it from the buddy allocator if it is empty.
+static struct run *
+cachepop(void)
+{
+  struct run *r;
+
+  push_off();
+  struct cpu *c = mycpu();
+  acquire(&c->kmemlock);
+  if (c->freelist == 0)
+    refill(c);
+  r = c->freelist;
+  if (r)
+  {
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->kmemlock);
+  pop_off();
+  return r;
+}
+
+static struct run *
+zpoolpop(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  r = zpool.free;
+  if (r)
+  {
+    zpool.free = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -108,27 +333,151 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if (r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  r = cachepop();
+  if (r == 0)
+    r = steal();
+  if (r == 0)
+    r = zpoolpop();
 
   if (r)
   {
-    #ifdef COW
-      acquire(&page_cow_lock);
-      int page_num = ((uint64)r / PGSIZE);
-      page_details[page_num].numReferences++;
-
-      // if(page_details[page_num].numReferences>0){
-      //   release(&page_cow_lock);
-      //   return;
-      // }
-      release(&page_cow_lock);
-    #endif
+#ifdef COW
+    __atomic_store_n(&refcnt[PAGE_INDEX(r)], 1, __ATOMIC_RELAXED);
+#endif
+#ifdef KDEBUG
     memset((char *)r, 5, PGSIZE); // fill with junk
+#endif
   }
 
   return (void *)r;
 }
+
+// Allocate one page of physical memory, filled with zeros.
+// Takes a page zeroed ahead of time if there is one.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if ((r = zpoolpop()) != 0)
+  {
+#ifdef COW
+    __atomic_store_n(&refcnt[PAGE_INDEX(r)], 1, __ATOMIC_RELAXED);
+#endif
+    r->next = 0;  // the only non-zero word
+    return (void *)r;
+  }
+  if ((r = kalloc()) != 0)
+    memset(r, 0, PGSIZE);
+  return (void *)r;
+}
+
+// Called by a hart with nothing to run: zero a few free
+// pages into the pool. Never steals from other harts.
+void
+kzeroidle(void)
+{
+  struct run *r;
+
+  for (int i = 0; i < ZBATCH && zpool.n < ZPOOLMAX; i++)
+  {
+    if ((r = cachepop()) == 0)
+      return;
+    memset(r, 0, PGSIZE);
+    acquire(&zpool.lock);
+    r->next = zpool.free;
+    zpool.free = r;
+    zpool.n++;
+    release(&zpool.lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size. Returns 0 if no free block is large enough.
+// Each page starts with one reference, as from kalloc().
+void *
+alloc_pages(int order)
+{
+  char *pa;
+
+  if (order < 0 || order > MAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  pa = buddyalloc(order);
+  release(&kmem.lock);
+  if (pa == 0)
+    return 0;
+
+#ifdef COW
+  for (int i = 0; i < (1 << order); i++)
+    __atomic_store_n(&refcnt[PAGE_INDEX(pa) + i], 1, __ATOMIC_RELAXED);
+#endif
+#ifdef KDEBUG
+  memset(pa, 5, PGSIZE << order); // fill with junk
+#endif
+  return pa;
+}
+
+// Free a block from alloc_pages(pa, order), whatever
+// reference counts its pages have.
+void
+free_pages(void *pa, int order)
+{
+  if (order < 0 || order > MAXORDER || ((uint64)pa - KERNBASE) % (PGSIZE << order) != 0 ||
+      (char *)pa < end || (uint64)pa + (PGSIZE << order) > phystop)
+    panic("free_pages");
+
+#ifdef COW
+  for (int i = 0; i < (1 << order); i++)
+    __atomic_store_n(&refcnt[PAGE_INDEX(pa) + i], 0, __ATOMIC_RELAXED);
+#endif
+#ifdef KDEBUG
+  memset(pa, 1, PGSIZE << order); // fill with junk
+#endif
+
+  acquire(&kmem.lock);
+  buddyfree(pa, order);
+  release(&kmem.lock);
+}
+
+// Number of free pages anywhere: in kmem, the harts' caches
+// and the zeroed pool. Read without locks, so only an estimate.
+uint64
+kfreepages(void)
+{
+  uint64 n = zpool.n;
+
+  for (int k = 0; k <= MAXORDER; k++)
+    n += kmem.nfree[k] << k;
+  for (int i = 0; i < ncpu; i++)
+    n += cpus[i].nfree;
+  return n;
+}
+
+// Number of free blocks of 2^order pages, not counting
+// pages in the harts' caches.
+uint64
+nfree_pages(int order)
+{
+  return kmem.nfree[order];
+}
+
+#ifdef COW
+// Take another reference to the page at pa, for
+// one more page table that maps it.
+void
+krefinc(void *pa)
+{
+  if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= phystop)
+    panic("krefinc");
+  if (__atomic_fetch_add(&refcnt[PAGE_INDEX(pa)], 1, __ATOMIC_RELAXED) <= 0)
+    panic("krefinc: free page");
+}
+
+// How many page tables map the page at pa.
+int
+krefget(void *pa)
+{
+  return __atomic_load_n(&refcnt[PAGE_INDEX(pa)], __ATOMIC_ACQUIRE);
+}
+#endif
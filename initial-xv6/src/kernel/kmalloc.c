@@ -0,0 +1,166 @@
+// Small-object allocator.
+//
+// kmalloc(n) hands out objects of up to PGSIZE/2 bytes from
+// power-of-two size classes (16 .. 2048 bytes), carved out of
+// whole pages from kalloc(); kfree_obj() gives them back.
+// Larger requests, up to a page, get a page of their own.
+//
+// Each class keeps a global list of free objects, and each hart
+// a short list of its own in struct cpu, so most calls take no
+// lock at all; objects move between the two KBATCH at a time.
+// A page, once carved up, stays with its class.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+
+extern char end[]; // first address after kernel; kernel.ld.
+
+#define KMINSIZE 16  // smallest class; class c holds KMINSIZE << c
+#define KCACHE   16  // most objects per class in a hart's list
+#define KBATCH   8   // objects moved to or from the global list at once
+
+struct kobj {
+  struct kobj *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct kobj *free;
+} kclass[NKCLASS];
+
+// per page: 1 + the class it was carved into, or 0.
+static uchar *pageclass;
+
+// called before kinit(), since it uses bootalloc().
+void
+kmallocinit(void)
+{
+  for(int c = 0; c < NKCLASS; c++)
+    initlock(&kclass[c].lock, "kmalloc");
+  pageclass = bootalloc(PAGE_COUNT);
+}
+
+static int
+sizeclass(uint64 n)
+{
+  int c = 0;
+
+  while((KMINSIZE << c) < n)
+    c++;
+  return c;
+}
+
+// Move up to KBATCH objects of class c from the global list to
+// this hart's, carving a new page if the global list is empty.
+// Interrupts must be off.
+static void
+refill(struct cpu *cpu, int c)
+{
+  struct kobj *o;
+  char *pa;
+  int size = KMINSIZE << c;
+
+  acquire(&kclass[c].lock);
+  if(kclass[c].free == 0 && (pa = kalloc()) != 0){
+    pageclass[PAGE_INDEX(pa)] = c + 1;
+    for(char *p = pa; p + size <= pa + PGSIZE; p += size){
+      o = (struct kobj *)p;
+      o->next = kclass[c].free;
+      kclass[c].free = o;
+    }
+  }
+  for(int i = 0; i < KBATCH && (o = kclass[c].free) != 0; i++){
+    kclass[c].free = o->next;
+    o->next = cpu->kobjs[c];
+    cpu->kobjs[c] = o;
+    cpu->nkobjs[c]++;
+  }
+  release(&kclass[c].lock);
+}
+
+// Move KBATCH objects of class c from this hart's list
+// back to the global one. Interrupts must be off.
+static void
+drain(struct cpu *cpu, int c)
+{
+  struct kobj *o;
+
+  acquire(&kclass[c].lock);
+  for(int i = 0; i < KBATCH && (o = cpu->kobjs[c]) != 0; i++){
+    cpu->kobjs[c] = o->next;
+    cpu->nkobjs[c]--;
+    o->next = kclass[c].free;
+    kclass[c].free = o;
+  }
+  release(&kclass[c].lock);
+}
+
+// Allocate n bytes of kernel memory, 16-byte aligned
+// (page-aligned above PGSIZE/2). Returns 0 if there is
+// none, or if n is more than a page.
+void *
+kmalloc(uint64 n)
+{
+  struct cpu *cpu;
+  struct kobj *o;
+  int c;
+
+  if(n > PGSIZE)
+    return 0;
+  if(n > (KMINSIZE << (NKCLASS - 1)))
+    return kalloc();
+
+  c = sizeclass(n);
+  push_off();
+  cpu = mycpu();
+  if(cpu->kobjs[c] == 0)
+    refill(cpu, c);
+  if((o = cpu->kobjs[c]) != 0){
+    cpu->kobjs[c] = o->next;
+    cpu->nkobjs[c]--;
+  }
+  pop_off();
+
+#ifdef KDEBUG
+  if(o)
+    memset(o, 5, KMINSIZE << c); // fill with junk
+#endif
+  return o;
+}
+
+// Free an object from kmalloc().
+void
+kfree_obj(void *p)
+{
+  struct cpu *cpu;
+  struct kobj *o = p;
+  int c;
+
+  if((char *)p < end || (uint64)p >= phystop)
+    panic("kfree_obj");
+  c = pageclass[PAGE_INDEX(p)] - 1;
+  if(c < 0){
+    // a whole page, from a request over PGSIZE/2.
+    kfree(p);
+    return;
+  }
+  if((uint64)p % (KMINSIZE << c) != 0)
+    panic("kfree_obj");
+
+#ifdef KDEBUG
+  memset(o, 1, KMINSIZE << c); // fill with junk to catch dangling refs
+#endif
+
+  push_off();
+  cpu = mycpu();
+  o->next = cpu->kobjs[c];
+  cpu->kobjs[c] = o;
+  if(++cpu->nkobjs[c] > KCACHE)
+    drain(cpu, c);
+  pop_off();
+}
@@ -0,0 +1,108 @@
+//
+// Lock contention statistics.
+//
+// initlock() and initsleeplock() map each lock name to a class,
+// with a search that is fine at boot; locks made at run time,
+// like pipes', use a class looked up once. acquire/release and acquiresleep/releasesleep count into this
+// hart's row of counters, so profiling adds no shared writes.
+// lockstat() sums the rows.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+#include "defs.h"
+
+static struct {
+  char name[16];
+  int sleep;
+  int nlocks;
+} class[NLOCKSTAT];
+static int nclass = 1;          // class 0 is "(other)"
+
+// guards class[]. a bare flag, since a spinlock would recurse.
+static uint classlock;
+
+// [ncpu][NLOCKSTAT]
+static struct lockcount *counts;
+
+void
+lockstatinit(void)
+{
+  safestrcpy(class[0].name, "(other)", sizeof(class[0].name));
+  counts = bootalloc(ncpu * NLOCKSTAT * sizeof(struct lockcount));
+}
+
+// find or make the class for locks called name,
+// and count n more locks in it.
+int
+lockclass(char *name, int sleep, int n)
+{
+  int i;
+
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  for(i = 1; i < nclass; i++)
+    if(class[i].sleep == sleep && strncmp(class[i].name, name, sizeof(class[i].name)) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKSTAT){
+      safestrcpy(class[i].name, name, sizeof(class[i].name));
+      class[i].sleep = sleep;
+      nclass++;
+    } else {
+      i = 0;
+    }
+  }
+  class[i].nlocks += n;
+  __sync_lock_release(&classlock);
+  return i;
+}
+
+// this hart's counters for a class.
+// interrupts must be off.
+struct lockcount *
+mylockcount(int id)
+{
+  return &counts[cpuid() * NLOCKSTAT + id];
+}
+
+// copy up to n classes' totals to user address dst.
+// returns the number copied, or -1.
+int
+lockstatread(uint64 dst, int n)
+{
+  struct lockstat ls;
+  struct lockcount *lc;
+  int i, c;
+
+  for(i = 0; i < n && i < nclass; i++){
+    memset(&ls, 0, sizeof(ls));
+    safestrcpy(ls.name, class[i].name, sizeof(ls.name));
+    ls.sleep = class[i].sleep;
+    ls.nlocks = class[i].nlocks;
+    for(c = 0; c < ncpu; c++){
+      lc = &counts[c * NLOCKSTAT + i];
+      ls.acquires += lc->acquires;
+      ls.contended += lc->contended;
+      ls.waittime += lc->waittime;
+      if(lc->maxhold > ls.maxhold)
+        ls.maxhold = lc->maxhold;
+    }
+    if(copyout(myproc()->pagetable, dst + i * sizeof(ls), (char *)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  return i;
+}
+
+// zero every counter. racy against other harts, which
+// may leave a few counts from just before the reset.
+void
+lockstatreset(void)
+{
+  memset(counts, 0, ncpu * NLOCKSTAT * sizeof(struct lockcount));
+}
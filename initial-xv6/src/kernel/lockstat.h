@@ -0,0 +1,24 @@
+// Lock contention statistics, kept per lock name.
+// lockstat() fills an array of struct lockstat.
+
+#define NLOCKSTAT   48   // lock names tracked; class 0 collects the rest
+
+struct lockstat {
+  char name[16];     // the name passed to initlock/initsleeplock
+  int sleep;         // 1 for a sleeplock
+  int nlocks;        // locks initialized with this name at boot
+  uint64 acquires;
+  uint64 contended;  // acquires that had to wait
+  uint64 waittime;   // time spent waiting (spinning, or asleep)
+  uint64 maxhold;    // longest time held
+};
+// times are in ticks of the time CSR, which all harts share,
+// for every kind of lock, so that they compare.
+
+// per-CPU counters for one name, updated with interrupts off.
+struct lockcount {
+  uint64 acquires;
+  uint64 contended;
+  uint64 waittime;
+  uint64 maxhold;
+};
@@ -0,0 +1,167 @@
+//
+// A small, fast LZ77 compressor in the style of LZ4, for
+// keeping swapped-out pages in RAM (see swap.c).
+//
+// The output is a series of sequences, each:
+//   token     high 4 bits: literal count; low 4 bits: match
+//             length - MINMATCH. 15 means more length follows,
+//             in bytes that each add 255 until a smaller one.
+//   literals
+//   offset    2 bytes, little-endian: how far back the match is
+//   match length bytes, if the token's low 4 bits are 15
+// The last sequence is only a token and literals.
+//
+// Matches are found through a hash table of recent 4-byte
+// strings, so only one caller may compress at a time.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define MINMATCH 4
+#define HASHBITS 10
+
+static ushort table[1 << HASHBITS];   // input offset, by hash
+
+static uint
+hash4(uchar *p)
+{
+  uint v = p[0] | p[1] << 8 | p[2] << 16 | (uint)p[3] << 24;
+
+  return (v * 2654435761U) >> (32 - HASHBITS);
+}
+
+// append the rest of a length of n beyond 15.
+static uchar *
+putlen(uchar *op, uchar *oend, uint n)
+{
+  for(; n >= 255; n -= 255){
+    if(op >= oend)
+      return 0;
+    *op++ = 255;
+  }
+  if(op >= oend)
+    return 0;
+  *op++ = n;
+  return op;
+}
+
+// append nlit literals from lit, then a match of mlen bytes
+// off bytes back, or no match if mlen is 0.
+// returns the new end of the output, or 0 if it doesn't fit.
+static uchar *
+putseq(uchar *op, uchar *oend, uchar *lit, uint nlit, uint off, uint mlen)
+{
+  uchar *token;
+
+  if(op >= oend)
+    return 0;
+  token = op++;
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if(nlit >= 15 && (op = putlen(op, oend, nlit - 15)) == 0)
+    return 0;
+  if(oend - op < nlit)
+    return 0;
+  memmove(op, lit, nlit);
+  op += nlit;
+  if(mlen == 0)
+    return op;
+
+  mlen -= MINMATCH;
+  *token |= mlen < 15 ? mlen : 15;
+  if(oend - op < 2)
+    return 0;
+  *op++ = off;
+  *op++ = off >> 8;
+  if(mlen >= 15 && (op = putlen(op, oend, mlen - 15)) == 0)
+    return 0;
+  return op;
+}
+
+// Compress the n bytes at src into dst, which holds max.
+// Returns the compressed length, or -1 if it is more than max.
+int
+lzcompress(char *src, int n, char *dst, int max)
+{
+  uchar *base = (uchar *)src, *ip = base, *anchor = base;
+  uchar *iend = base + n;
+  uchar *op = (uchar *)dst, *oend = op + max;
+
+  memset(table, 0, sizeof(table));
+  while(n >= MINMATCH && ip <= iend - MINMATCH){
+    uint h = hash4(ip);
+    uchar *ref = base + table[h];
+    table[h] = ip - base;
+    if(ref >= ip || ip - ref > 0xffff || memcmp(ref, ip, MINMATCH) != 0){
+      ip++;
+      continue;
+    }
+    uchar *mp = ip + MINMATCH, *rp = ref + MINMATCH;
+    while(mp < iend && *mp == *rp){
+      mp++;
+      rp++;
+    }
+    if((op = putseq(op, oend, anchor, ip - anchor, ip - ref, mp - ip)) == 0)
+      return -1;
+    ip = anchor = mp;
+  }
+  if((op = putseq(op, oend, anchor, iend - anchor, 0, 0)) == 0)
+    return -1;
+  return op - (uchar *)dst;
+}
+
+// add the bytes that continue a length to *len.
+static int
+getlen(uchar **ipp, uchar *iend, uint *len)
+{
+  uchar *ip = *ipp;
+  uint b;
+
+  do{
+    if(ip >= iend)
+      return -1;
+    b = *ip++;
+    *len += b;
+  }while(b == 255);
+  *ipp = ip;
+  return 0;
+}
+
+// Decompress the n bytes at src into dst, which holds max.
+// Returns the decompressed length, or -1 if src is corrupt.
+int
+lzdecompress(char *src, int n, char *dst, int max)
+{
+  uchar *ip = (uchar *)src, *iend = ip + n;
+  uchar *op = (uchar *)dst, *oend = op + max;
+
+  while(ip < iend){
+    uint token = *ip++;
+    uint len = token >> 4;
+    if(len == 15 && getlen(&ip, iend, &len) < 0)
+      return -1;
+    if(iend - ip < len || oend - op < len)
+      return -1;
+    memmove(op, ip, len);
+    op += len;
+    ip += len;
+    if(ip == iend)
+      break;
+
+    if(iend - ip < 2)
+      return -1;
+    uint off = ip[0] | ip[1] << 8;
+    ip += 2;
+    len = token & 15;
+    if(len == 15 && getlen(&ip, iend, &len) < 0)
+      return -1;
+    len += MINMATCH;
+    if(off == 0 || off > op - (uchar *)dst || oend - op < len)
+      return -1;
+    // byte by byte: the match may overlap what it makes.
+    for(uchar *ref = op - off; len > 0; len--)
+      *op++ = *ref++;
+  }
+  return op - (uchar *)dst;
+}
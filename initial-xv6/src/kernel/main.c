@@ -11,23 +11,33 @@ void
 main()
 {
   if(cpuid() == 0){
+    fdtinit(bootdtb); // count harts and RAM
+    cpuinit();       // per-CPU state, needed by locks
+    lockstatinit();  // lock contention counters
     consoleinit();
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
+    printf("%d harts, %dMB of RAM\n", ncpu, (int)((phystop - KERNBASE) >> 20));
     printf("\n");
     // printf("here\n");
+    kmallocinit();   // small-object allocator
+    swapinit();      // swap slots and reverse map
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space identifiers
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcacheinit();    // page cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipes
+    shminit();       // shared-memory segments
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
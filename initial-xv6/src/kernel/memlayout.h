@@ -14,8 +14,10 @@
 
 // the kernel uses physical memory thus:
 // 80000000 -- entry.S, then kernel text and data
-// end -- start of kernel page allocation area
-// PHYSTOP -- end RAM used by the kernel
+// end -- one boot page per hart (stack, timer scratch)
+//        then per-CPU state and page metadata (bootalloc)
+//        then the kernel page allocation area
+// phystop -- end RAM used by the kernel, from the device tree
 
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
@@ -43,9 +45,13 @@
 
 // the kernel expects there to be RAM
 // for use by the kernel and user pages
-// from physical address 0x80000000 to PHYSTOP.
+// from physical address 0x80000000 to phystop,
+// which fdtinit() finds in the device tree.
+// PHYSTOP is the default if there is none;
+// RAM past PHYSTOP_MAX is ignored.
 #define KERNBASE 0x80000000L
 #define PHYSTOP (KERNBASE + 128*1024*1024)
+#define PHYSTOP_MAX (KERNBASE + 64L*1024*1024*1024)
 
 // map the trampoline page to the highest address,
 // in both user and kernel space.
@@ -65,3 +71,11 @@
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// the kernel's direct map of RAM, again, at the bottom of the
+// top half of the address space, which only Sv39's sign
+// extension reaches. each user page table maps it, with 1GB
+// pages and no PTE_U, so that ucopy() in trampoline.S can
+// reach both a kernel buffer and user memory with satp holding
+// the user page table. KWINDOW + pa is where pa is.
+#define KWINDOW 0xffffffc000000000L
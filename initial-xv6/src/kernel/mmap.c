@@ -0,0 +1,365 @@
+//
+// Memory-mapped files: mmap() and munmap().
+//
+// Each process has up to NVMA mappings (struct vma, in struct
+// proc), placed top-down below the trapframe; the heap may grow
+// up to the lowest of them. Nothing is read at mmap() time: on
+// a page's first touch, mmapfault(), which uvmlazy() calls for
+// addresses above p->sz, maps the page cache's copy of it (see
+// pcache.c), so that read() and every mapping see the same page.
+//
+// A page of a MAP_SHARED mapping is mapped read-only until it is
+// first written, when mmapwrite() makes it writable and marks it
+// dirty (PTE_D). Dirty pages are written back to the file by
+// munmap(), exec() and exit(). A writable MAP_PRIVATE mapping
+// maps pages copy-on-write, so that writes to it stay private.
+// Until a process writes a MAP_PRIVATE page, though, it maps
+// the cached page itself, and so sees writes made to the file
+// meanwhile, by write() or through MAP_SHARED mappings; a page
+// it has written is its own copy and sees none.
+// fork() shares MAP_SHARED pages with the child, and MAP_PRIVATE
+// ones copy-on-write.
+//
+// shm_attach() maps shared-memory segments (see shm.c) as
+// regions too, with no file behind them: v->shm instead of v->f.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "defs.h"
+
+static struct vma *
+vmafind(struct proc *p, uint64 va)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && v->addr <= va && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// The lowest address of any mapping, or TRAPFRAME if there
+// are none: the heap may grow up to here.
+uint64
+mmapbase(struct proc *p)
+{
+  uint64 base = TRAPFRAME;
+
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Find room for a region of len bytes below the current
+// ones, and a free slot to describe it. Returns the slot with
+// addr and len filled in, or 0.
+static struct vma *
+vmaalloc(struct proc *p, uint64 len)
+{
+  struct vma *v;
+  uint64 base;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return 0;
+
+  len = PGROUNDUP(len);
+  base = mmapbase(p);
+  if(len > base || base - len < PGROUNDUP(p->sz))
+    return 0;
+
+  v->addr = base - len;
+  v->len = len;
+  return v;
+}
+
+// Map len bytes of f, starting at offset off, below the
+// current mappings. Returns the address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint64 off)
+{
+  struct vma *v;
+
+  if(len == 0 || len > MAXVA || off % PGSIZE != 0 || f->type != FD_INODE || !f->readable)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+
+  if((v = vmaalloc(myproc(), len)) == 0)
+    return -1;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = filedup(f);
+  v->shm = 0;
+  v->off = off;
+  return v->addr;
+}
+
+// Map len bytes of shared-memory segment s, for shmattach(),
+// which has already counted the new attachment.
+uint64
+mmapshm(struct shm *s, uint64 len)
+{
+  struct vma *v;
+
+  if((v = vmaalloc(myproc(), len)) == 0)
+    return -1;
+  v->prot = PROT_READ | PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->f = 0;
+  v->shm = s;
+  v->off = 0;
+  return v->addr;
+}
+
+// Map the page of a mapped file that holds va, or that page
+// of a shared-memory segment, on its first touch.
+// Returns the page's physical address, or 0 if va is not
+// mapped, the access isn't allowed, or out of memory.
+uint64
+mmapfault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  uint64 pa;
+  int perm = PTE_U;
+
+  if((v = vmafind(p, va)) == 0)
+    return 0;
+  if(v->prot & PROT_READ)
+    perm |= PTE_R;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(v->prot & PROT_WRITE){
+    perm |= PTE_R;
+    // segment pages are never written back, so need no PTE_D.
+    // a write to a private mapping copies the page first.
+    if(v->shm)
+      perm |= PTE_W;
+    else if(v->flags == MAP_PRIVATE)
+      perm |= PTE_CoW;
+    else if(write)
+      perm |= PTE_W | PTE_D;
+  }
+  if((perm & (PTE_R|PTE_X)) == 0 || (write && (perm & (PTE_W|PTE_CoW)) == 0))
+    return 0;
+
+  va = PGROUNDDOWN(va);
+  if(v->shm){
+    pa = shmpage(v->shm, (v->off + (va - v->addr)) / PGSIZE);
+    if(pa == 0 || mappages(p->pagetable, va, PGSIZE, pa, perm) != 0)
+      return 0;
+    return pa;
+  }
+
+  // past the end of the file, the page is zero.
+  ilock(v->f->ip);
+  pa = readpage(v->f->ip, (v->off + (va - v->addr)) / PGSIZE);
+  iunlock(v->f->ip);
+  if(pa == 0)
+    return 0;
+
+  if(mappages(p->pagetable, va, PGSIZE, pa, perm) != 0){
+    kfree((void *)pa);
+    return 0;
+  }
+  return pa;
+}
+
+// A write to a page of a MAP_SHARED mapping that is still
+// read-only: make it writable, and dirty. Returns -1 if va
+// is not in a writable mapping.
+int
+mmapwrite(struct proc *p, uint64 va, pte_t *pte)
+{
+  struct vma *v = vmafind(p, va);
+
+  if(v == 0 || (v->prot & PROT_WRITE) == 0)
+    return -1;
+  *pte |= PTE_W | PTE_D;
+  tlbflush(p->pagetable, PGROUNDDOWN(va));
+  return 0;
+}
+
+// Write one dirty page back to the file, but not past its end:
+// a mapping doesn't make the file grow.
+static void
+writeback(struct vma *v, uint64 va, uint64 pa)
+{
+  struct inode *ip = v->f->ip;
+  uint off = v->off + (va - v->addr);
+  // as in filewrite(), keep each transaction small.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+
+  for(int i = 0; i < PGSIZE; i += max){
+    begin_op();
+    ilock(ip);
+    if(off + i < ip->size){
+      uint n = ip->size - (off + i);
+      if(n > max)
+        n = max;
+      if(n > PGSIZE - i)
+        n = PGSIZE - i;
+      writei(ip, 0, pa + i, off + i, n);
+    }
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Remove [addr, addr+len) of mapping v from pagetable,
+// writing back dirty pages if it is a MAP_SHARED file.
+// A segment's pages stay with the segment.
+static void
+vmaunmap(pagetable_t pagetable, struct vma *v, uint64 addr, uint64 len)
+{
+  pte_t *pte;
+
+  if(v->f && v->flags == MAP_SHARED){
+    for(uint64 a = addr; a < addr + len; a += PGSIZE){
+      pte = walk(pagetable, a, 0);
+      if(pte && (*pte & PTE_V) && (*pte & PTE_D))
+        writeback(v, a, PTE2PA(*pte));
+    }
+  }
+  uvmunmap(pagetable, addr, len / PGSIZE, v->shm == 0);
+}
+
+// Drop v's file or segment, and free the slot. Never sleeps
+// unless this is the last reference to the file.
+static void
+vmaclose(struct vma *v)
+{
+  if(v->f)
+    fileclose(v->f);
+  else
+    shmput(v->shm);
+  v->f = 0;
+  v->shm = 0;
+  v->len = 0;
+}
+
+// Unmap [addr, addr+len), which must be the start, the end
+// or all of one mapping. Returns 0, or -1.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  if(addr % PGSIZE != 0 || len == 0 || len > MAXVA)
+    return -1;
+  len = PGROUNDUP(len);
+  if((v = vmafind(p, addr)) == 0 || addr + len > v->addr + v->len)
+    return -1;
+  if(addr != v->addr && addr + len != v->addr + v->len)
+    return -1;
+
+  vmaunmap(p->pagetable, v, addr, len);
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0)
+    vmaclose(v);
+  return 0;
+}
+
+// Remove all of p's mappings, at exit() or exec().
+void
+mmapexit(struct proc *p)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    vmaunmap(p->pagetable, v, v->addr, v->len);
+    vmaclose(v);
+  }
+}
+
+// Undo a failed mmapfork(). Unlike mmapexit(), this never
+// sleeps (fork() holds np->lock): there is nothing to write
+// back yet, and p still holds each file and segment, so
+// vmaclose() only drops a reference.
+static void
+vmadrop(struct proc *np)
+{
+  for(struct vma *v = np->vma; v < &np->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    uvmunmap(np->pagetable, v->addr, v->len / PGSIZE, v->shm == 0);
+    vmaclose(v);
+  }
+}
+
+// Give child np copies of p's mappings. Pages already read in
+// are shared: MAP_SHARED ones as they are, writable MAP_PRIVATE
+// ones copy-on-write, and segment pages without a reference
+// of their own. A MAP_SHARED page that neither has touched yet
+// is shared too, once each faults it in, since mmapfault()
+// maps the page cache's page; unless the cache is full of
+// mapped pages, when each gets a private one. Returns -1 if
+// out of memory, with none of np's mappings left.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  // p's writable private pages become copy-on-write.
+  tlbstale(p->pagetable);
+  for(int i = 0; i < NVMA; i++){
+    struct vma *v = &p->vma[i];
+    if(v->len == 0)
+      continue;
+    np->vma[i] = *v;
+    if(v->f)
+      filedup(v->f);
+    else
+      shmdup(v->shm);
+    for(uint64 a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      pte_t *pte = walk(p->pagetable, a, 0);
+      if(pte == 0 || (*pte & PTE_V) == 0)
+        continue;
+      uint64 pa = PTE2PA(*pte);
+      if(v->shm){
+        if(mappages(np->pagetable, a, PGSIZE, pa, PTE_FLAGS(*pte) & ~PTE_V) != 0){
+          vmadrop(np);
+          return -1;
+        }
+        continue;
+      }
+#ifdef COW
+      if(v->flags == MAP_PRIVATE && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_CoW;
+      if(mappages(np->pagetable, a, PGSIZE, pa, PTE_FLAGS(*pte) & ~PTE_V) != 0){
+        vmadrop(np);
+        return -1;
+      }
+      krefinc((void *)pa);
+#else
+      char *mem;
+      if((mem = kalloc()) == 0){
+        vmadrop(np);
+        return -1;
+      }
+      memmove(mem, (char *)pa, PGSIZE);
+      if(mappages(np->pagetable, a, PGSIZE, (uint64)mem, PTE_FLAGS(*pte) & ~PTE_V) != 0){
+        kfree(mem);
+        vmadrop(np);
+        return -1;
+      }
+#endif
+    }
+  }
+  return 0;
+}
@@ -1,5 +1,5 @@
 #define NPROC        64  // maximum number of processes
-#define NCPU          8  // maximum number of CPUs
+#define NCPU          8  // CPUs assumed without a device tree
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -9,5 +9,13 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NPCACHE      512   // pages of file data cached, at most
 #define FSSIZE       2000  // size of file system in blocks
+#define SWAPSIZE     65536 // size of the swap area after it, in blocks
+#define NZRAM        4096  // swapped-out pages kept compressed in RAM, at most
 #define MAXPATH      128   // maximum file path name
+#define MAXORDER     10    // largest alloc_pages() block is 2^MAXORDER pages
+#define NKCLASS      8     // kmalloc() size classes, 16 .. 2048 bytes
+#define NVMA         16    // mmap() regions per process
+#define NSHM         16    // shared-memory segments
+#define NSHMPAGES    256   // pages per segment, at most
@@ -0,0 +1,217 @@
+//
+// Page cache: whole 4KB pages of file data, by inode and
+// page number within the file.
+//
+// readi() and writei() go through it for regular files, and
+// mmap() maps its pages straight into processes, so a hot file
+// is read from the disk once and then only copied or mapped.
+// exec() copies programs in with readi(), since a running
+// program mustn't see later writes to its file. Directories
+// and the file system's own blocks stay in the buffer cache
+// (bio.c).
+//
+// The cache holds a reference (krefinc()) to each of its pages,
+// and hands out another with every lookup; a page mapped into
+// some process is never recycled, so that it stays the one copy
+// of its part of the file. writei() writes through: it updates
+// the cached page and logs the blocks as before, so pages are
+// never dirty and can be dropped at any time, as swapreclaim()
+// does when memory is short. readpage() in fs.c fills pages;
+// all callers hold the inode's lock, so no two fill the same
+// one at once.
+//
+// Like copy-on-write, this needs page reference counts.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "vmstat.h"
+#include "defs.h"
+
+#ifndef COW
+#error "the page cache needs COW's page reference counts"
+#endif
+
+#define NPCHASH 127
+
+extern struct vmstat vmstat;
+
+struct page {
+  uint dev;
+  uint inum;
+  uint pgno;
+  uint64 pa;                  // 0 if this entry is free
+  struct page *hnext;         // hash chain
+  struct page *prev, *next;   // LRU list
+};
+
+struct {
+  struct spinlock lock;
+  struct page page[NPCACHE];
+  struct page *hash[NPCHASH];
+
+  // as in bio.c: head.next is the most recently used,
+  // head.prev the least. free entries are at the end.
+  struct page head;
+} pcache;
+
+void
+pcacheinit(void)
+{
+  struct page *pg;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+static struct page **
+bucket(uint dev, uint inum, uint pgno)
+{
+  return &pcache.hash[(dev * 31 + inum * 17 + pgno) % NPCHASH];
+}
+
+static struct page *
+lookup(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  for(pg = *bucket(ip->dev, ip->inum, pgno); pg; pg = pg->hnext)
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->pgno == pgno)
+      return pg;
+  return 0;
+}
+
+// move pg to the head of the LRU list, or the tail.
+static void
+touch(struct page *pg, int recent)
+{
+  struct page *at = recent ? &pcache.head : pcache.head.prev;
+
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  pg->next = at->next;
+  pg->prev = at;
+  at->next->prev = pg;
+  at->next = pg;
+}
+
+// drop pg's page and free the entry. pcache.lock must be held.
+static void
+evict(struct page *pg)
+{
+  struct page **pp = bucket(pg->dev, pg->inum, pg->pgno);
+
+  while(*pp != pg)
+    pp = &(*pp)->hnext;
+  *pp = pg->hnext;
+  kfree((void *)pg->pa);
+  pg->pa = 0;
+  touch(pg, 0);
+}
+
+// Find page pgno of ip's data in the cache.
+// Returns its physical address, with a reference for the
+// caller to kfree(), or 0 if it isn't there.
+uint64
+pcachefind(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+  uint64 pa = 0;
+
+  acquire(&pcache.lock);
+  if((pg = lookup(ip, pgno)) != 0){
+    pa = pg->pa;
+    krefinc((void *)pa);
+    touch(pg, 1);
+  }
+  release(&pcache.lock);
+  __atomic_fetch_add(pa ? &vmstat.pcachehit : &vmstat.pcachemiss, 1, __ATOMIC_RELAXED);
+  return pa;
+}
+
+// Cache the page at pa, just read in, as page pgno of ip's
+// data. The caller keeps its own reference. If every entry
+// holds a page that some process maps, the page isn't cached.
+void
+pcacheadd(struct inode *ip, uint pgno, void *pa)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->pa == 0 || krefget((void *)pg->pa) == 1){
+      if(pg->pa)
+        evict(pg);
+      pg->dev = ip->dev;
+      pg->inum = ip->inum;
+      pg->pgno = pgno;
+      pg->pa = (uint64)pa;
+      krefinc(pa);
+      struct page **b = bucket(ip->dev, ip->inum, pgno);
+      pg->hnext = *b;
+      *b = pg;
+      touch(pg, 1);
+      break;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// writei() has put the n bytes at src into ip at off, which
+// are all in one page: update that page, if it is cached.
+void
+pcacheupdate(struct inode *ip, uint off, char *src, uint n)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  if((pg = lookup(ip, off / PGSIZE)) != 0)
+    memmove((char *)pg->pa + off % PGSIZE, src, n);
+  release(&pcache.lock);
+}
+
+// ip's contents are going away: forget its pages. Processes
+// that map them keep them, as private copies.
+void
+pcachedrop(struct inode *ip)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++)
+    if(pg->pa && pg->dev == ip->dev && pg->inum == ip->inum)
+      evict(pg);
+  release(&pcache.lock);
+}
+
+// Free up to n cached pages that no process maps, least
+// recently used first. Returns how many were freed.
+int
+pcacheshrink(int n)
+{
+  struct page *pg, *prev;
+  int done = 0;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head && done < n; pg = prev){
+    prev = pg->prev;
+    if(pg->pa && krefget((void *)pg->pa) == 1){
+      evict(pg);
+      done++;
+    }
+  }
+  release(&pcache.lock);
+  return done;
+}
@@ -19,6 +19,16 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// lock statistics class of pipe locks, which pipealloc()
+// would otherwise look up, and count, every time.
+static int pipeclass;
+
+void
+pipeinit(void)
+{
+  pipeclass = lockclass("pipe", 0, 0);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,13 +38,13 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kmalloc(sizeof(*pi))) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
-  initlock(&pi->lock, "pipe");
+  initlockid(&pi->lock, "pipe", pipeclass);
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -47,7 +57,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kfree_obj(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +78,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kfree_obj(pi);
   } else
     release(&pi->lock);
 }
@@ -6,17 +6,12 @@
 #include "proc.h"
 #include "defs.h"
 
-struct cpu cpus[NCPU];
+struct cpu *cpus;
 
 struct proc proc[NPROC];
 
 struct proc *initproc;
 
-#ifdef COW
-extern struct cow_info page_details[];
-extern struct spinlock page_cow_lock;
-#endif
-
 struct proc *Queue[4][NPROC];
 // int front_ptrs[4];
 // int rear_ptrs[4];
@@ -96,6 +91,13 @@ void proc_mapstacks(pagetable_t kpgtbl)
   }
 }
 
+// allocate a struct cpu for each hart in the device tree.
+// indexed by hartid, so this must precede any lock.
+void cpuinit(void)
+{
+  cpus = bootalloc(ncpu * sizeof(struct cpu));
+}
+
 // initialize the proc table.
 void procinit(void)
 {
@@ -179,6 +181,11 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->pinlen = 0;
+  p->shmopened = 0;
+  p->asidgen = 0;
+  p->tlbstale = 0;
+  p->tlbcpu = 0;
 
   // Allocate a trapframe page.
   if ((p->trapframe = (struct trapframe *)kalloc()) == 0)
@@ -214,6 +221,14 @@ found:
 
   p->sleep_start=p->sleep_end=0;
 
+  p->fpused = 0;
+  p->fpdirty = 0;
+  p->fpcpu = 0;
+  memset(&p->fpstate, 0, sizeof(p->fpstate));
+  p->vecused = 0;
+  p->vecdirty = 0;
+  p->veccpu = 0;
+  memset(&p->vecstate, 0, sizeof(p->vecstate));
 
   p->alarmticks = 0;
   p->alarmhandler = 0;
@@ -239,6 +254,13 @@ freeproc(struct proc *p)
   if (p->trapframe)
     kfree((void *)p->trapframe);
   p->trapframe = 0;
+  if (p->vecstate.regs)
+    kfree(p->vecstate.regs);
+  p->vecstate.regs = 0;
+  p->vecused = 0;
+  if (p->alarm_tf)
+    kfree_obj(p->alarm_tf);
+  p->alarm_tf = 0;
   if (p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -285,6 +307,9 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // the kernel window, for copyin() and copyout().
+  kwinmap(pagetable);
+
   return pagetable;
 }
 
@@ -292,6 +317,7 @@ proc_pagetable(struct proc *p)
 // physical memory it refers to.
 void proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
+  kwinunmap(pagetable);
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
   uvmfree(pagetable, sz);
@@ -349,10 +375,11 @@ int growproc(int n)
   sz = p->sz;
   if (n > 0)
   {
-    if ((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0)
-    {
+    // just reserve the address space; the pages are
+    // allocated on first touch, by uvmlazy().
+    if (sz + n > mmapbase(p))
       return -1;
-    }
+    sz += n;
   }
   else if (n < 0)
   {
@@ -392,19 +419,37 @@ int fork(void)
   uint flags;
   // char *mem;
 
+  // the parent's pages become copy-on-write too.
+  tlbstale(p->pagetable);
   for (j = 0; j < p->sz; j += PGSIZE)
   {
+    // megapages are shared as 4KB pages, so that
+    // a write copies 4KB, not 2MB.
+    if (uvmsplit(p->pagetable, j) < 0)
+    {
+      uvmunmap(np->pagetable, 0, j / PGSIZE, 1);
+      freeproc(np);
+      release(&np->lock);
+      return -1;
+    }
+    // a heap page that was never touched: the child
+    // allocates its own on first touch.
     if ((pte = walk(p->pagetable, j, 0)) == 0)
-      panic("cow_fork: pte should exist");
+      continue;
     if ((*pte & PTE_V) == 0)
-      panic("cow_fork: page not present");
+    {
+      // swapped out: the child shares the swap slot.
+      if ((*pte & PTE_S) && swapfork(np->pagetable, j, *pte) < 0)
+      {
+        uvmunmap(np->pagetable, 0, j / PGSIZE, 1);
+        freeproc(np);
+        release(&np->lock);
+        return -1;
+      }
+      continue;
+    }
     pa = PTE2PA(*pte);
-    acquire(&page_cow_lock);
-    int page_num = ((uint64)pa / PGSIZE);
-    page_details[page_num].numReferences++;
-    page_details[page_num].p = np;
-    page_details[page_num].page_number = page_num;
-    release(&page_cow_lock);
+    krefinc((void *)pa);
     flags = PTE_FLAGS(*pte);
     flags &= (~PTE_W);
     flags |= PTE_CoW;
@@ -430,6 +475,37 @@ int fork(void)
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
+  // and the f and v registers, which may only be live in this hart.
+  push_off();
+  fpusave(p);
+  vecusave(p);
+  pop_off();
+  np->fpused = p->fpused;
+  np->fpstate = p->fpstate;
+  if (p->vecused)
+  {
+    if ((np->vecstate.regs = kalloc()) == 0)
+    {
+      freeproc(np);
+      release(&np->lock);
+      return -1;
+    }
+    memmove(np->vecstate.regs, p->vecstate.regs, PGSIZE);
+    np->vecstate.vstart = p->vecstate.vstart;
+    np->vecstate.vl = p->vecstate.vl;
+    np->vecstate.vtype = p->vecstate.vtype;
+    np->vecstate.vcsr = p->vecstate.vcsr;
+    np->vecused = 1;
+  }
+
+  // and the mmap()ed regions.
+  if (mmapfork(p, np) < 0)
+  {
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
@@ -492,6 +568,10 @@ void exit(int status)
   if (p == initproc)
     panic("init exiting");
 
+  // Write back and drop mmap()ed regions, while the files are open.
+  mmapexit(p);
+  shmexit(p);
+
   // Close all open files.
   for (int fd = 0; fd < NOFILE; fd++)
   {
@@ -703,6 +783,8 @@ void scheduler(void)
         break;
       }
     }
+    if (highestPriorProc == 0)
+      kzeroidle();
     if (highestPriorProc)
     {
       // printf("Process: %p", highestPriorProc);
@@ -725,6 +807,7 @@ void scheduler(void)
   {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
+    int ran = 0;
 
     for (p = proc; p < &proc[NPROC]; p++)
     {
@@ -734,6 +817,7 @@ void scheduler(void)
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
+        ran = 1;
         p->state = RUNNING;
         p->numScheduled++;
         c->proc = p;
@@ -745,6 +829,10 @@ void scheduler(void)
       }
       release(&p->lock);
     }
+
+    // nothing to run: do some work for kalloc_zeroed().
+    if (!ran)
+      kzeroidle();
   }
 }
 #endif
@@ -824,6 +912,10 @@ void scheduler(void)
       release(&p->lock);
     }
 
+    // nothing to run: do some work for kalloc_zeroed().
+    if (max_priority_proc == 0)
+      kzeroidle();
+
     if (max_priority_proc != 0)
     {
       // printf("%d\n", max_priority_proc->pid);
@@ -873,6 +965,11 @@ void sched(void)
   if (intr_get())
     panic("sched interruptible");
 
+  // the next process to use this hart's FPU or vector
+  // unit would overwrite p's unsaved registers.
+  fpusave(p);
+  vecusave(p);
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -961,6 +1058,17 @@ void wakeup(void *chan)
   }
 }
 
+// Wake p alone, if it is sleeping on chan.
+// For callers that know exactly which process to wake.
+// Must be called without p->lock.
+void wakeproc(struct proc *p, void *chan)
+{
+  acquire(&p->lock);
+  if (p->state == SLEEPING && p->chan == chan)
+    p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Kill the process with the given pid.
 // The victim won't exit until it tries to return
 // to user space (see usertrap() in trap.c).
@@ -19,6 +19,24 @@ struct context
   uint64 s11;
 };
 
+// Saved user floating-point registers.
+struct fpstate
+{
+  uint64 f[32];
+  uint64 fcsr;
+};
+
+// Saved user vector state. regs points to a page holding
+// v0..v31, allocated when the process first uses the vector unit.
+struct vecstate
+{
+  /*   0 */ uint64 vstart;
+  /*   8 */ uint64 vl;
+  /*  16 */ uint64 vtype;
+  /*  24 */ uint64 vcsr;
+  /*  32 */ char *regs;
+};
+
 // Per-CPU state.
 struct cpu
 {
@@ -26,9 +44,22 @@ struct cpu
   struct context context; // swtch() here to enter scheduler().
   int noff;               // Depth of push_off() nesting.
   int intena;             // Were interrupts enabled before push_off()?
+  struct proc *fpowner;   // Process whose f registers this hart holds.
+  struct proc *vecowner;  // Process whose v registers this hart holds.
+
+  // This hart's cache of free pages; see kalloc.c.
+  struct spinlock kmemlock;
+  struct run *freelist;
+  int nfree;
+
+  // This hart's free kmalloc() objects, by size class.
+  struct kobj *kobjs[NKCLASS];
+  int nkobjs[NKCLASS];
+
+  uint64 asidgen;         // ASID generation this hart's TLB is in; see asid.c
 };
 
-extern struct cpu cpus[NCPU];
+extern struct cpu *cpus;
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
@@ -92,6 +123,18 @@ enum procstate
   ZOMBIE
 };
 
+// A region of a file mapped by mmap(); len == 0 if unused.
+struct vma
+{
+  uint64 addr;       // Page-aligned start
+  uint64 len;        // Length, a whole number of pages
+  int prot;          // PROT_READ etc.
+  int flags;         // MAP_SHARED or MAP_PRIVATE
+  struct file *f;    // The mapped file, or
+  struct shm *shm;   // the shared-memory segment; see shm.c
+  uint64 off;        // Offset of addr in the file
+};
+
 // Per-process state
 struct proc
 {
@@ -106,6 +149,7 @@ struct proc
 
   // wait_lock must be held when using this:
   struct proc *parent; // Parent process
+  struct proc *lknext; // Next waiter for the same sleeplock
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -116,6 +160,24 @@ struct proc
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int inuser;                  // Preempted in usertrap(); see swap.c
+  uint64 pinva, pinlen;        // What uvmprefault() read in; see swap.c
+  uint64 asid;                 // Address-space identifier; see asid.c
+  uint64 asidgen;              // Its generation; 0 until assigned
+  int tlbstale;                // Flush the ASID before user space?
+  struct cpu *tlbcpu;          // Hart last in user space with it
+  struct vma vma[NVMA];        // mmap()ed regions; see mmap.c
+  uint shmopened;              // shm_open()ed segments, a bit each; see shm.c
+
+  // lazily switched floating-point state; see usertrap().
+  int fpused;                  // Has the process turned the FPU on?
+  int fpdirty;                 // Hart f registers newer than fpstate?
+  struct cpu *fpcpu;           // Hart last loaded with fpstate
+  struct fpstate fpstate;      // Saved f registers and fcsr
+  int vecused;                 // Same for the vector unit
+  int vecdirty;
+  struct cpu *veccpu;
+  struct vecstate vecstate;
   uint rtime;                  // How long the process ran for
   uint ctime;                  // When was the process created
   uint etime;                  // When did the process exited
@@ -142,10 +204,4 @@ struct proc
   int numScheduled;
 };
 
-struct cow_info{
-  struct proc* p;
-  int page_number;
-  int numReferences;
-};
-
 extern struct proc proc[NPROC];
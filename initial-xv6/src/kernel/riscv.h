@@ -9,6 +9,17 @@ r_mhartid()
   return x;
 }
 
+// Machine ISA Register, misa
+#define MISA_V (1L << ('V' - 'A')) // vector extension
+
+static inline uint64
+r_misa()
+{
+  uint64 x;
+  asm volatile("csrr %0, misa" : "=r" (x) );
+  return x;
+}
+
 // Machine Status Register, mstatus
 
 #define MSTATUS_MPP_MASK (3L << 11) // previous mode.
@@ -47,6 +58,15 @@ w_mepc(uint64 x)
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
 #define SSTATUS_SIE (1L << 1)  // Supervisor Interrupt Enable
 #define SSTATUS_UIE (1L << 0)  // User Interrupt Enable
+#define SSTATUS_FS (3L << 13)  // Floating-point unit status:
+#define SSTATUS_FS_OFF (0L << 13)     //   f instructions trap
+#define SSTATUS_FS_INITIAL (1L << 13)
+#define SSTATUS_FS_CLEAN (2L << 13)   //   f registers unchanged
+#define SSTATUS_FS_DIRTY (3L << 13)   //   f registers written
+#define SSTATUS_VS (3L << 9)   // Vector unit status, same encoding
+#define SSTATUS_VS_OFF (0L << 9)
+#define SSTATUS_VS_CLEAN (2L << 9)
+#define SSTATUS_VS_DIRTY (3L << 9)
 
 static inline uint64
 r_sstatus()
@@ -199,7 +219,10 @@ w_pmpaddr0(uint64 x)
 // use riscv's sv39 page table scheme.
 #define SATP_SV39 (8L << 60)
 
-#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+#define SATP_ASIDMASK 0xffffL
+#define SATP_ASID(satp) (((satp) >> 44) & SATP_ASIDMASK)
+
+#define MAKE_SATP(pagetable, asid) (SATP_SV39 | ((uint64)(asid) << 44) | (((uint64)pagetable) >> 12))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -256,7 +279,8 @@ r_mcounteren()
   return x;
 }
 
-// machine-mode cycle counter
+// real-time counter, the same on every hart;
+// start() lets supervisor mode read it.
 static inline uint64
 r_time()
 {
@@ -265,6 +289,15 @@ r_time()
   return x;
 }
 
+// cycle counter; start() lets supervisor mode read it.
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // enable device interrupts
 static inline void
 intr_on()
@@ -279,6 +312,43 @@ intr_off()
   w_sstatus(r_sstatus() & ~SSTATUS_SIE);
 }
 
+// turn the FPU on or off for the kernel itself, which
+// only needs it to save and restore user f registers.
+static inline void
+fpu_on()
+{
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+}
+
+static inline void
+fpu_off()
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_FS);
+}
+
+// likewise for the vector unit.
+static inline void
+vec_on()
+{
+  w_sstatus((r_sstatus() & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+}
+
+static inline void
+vec_off()
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+}
+
+// vector register length in bytes.
+// the vector unit must be on.
+static inline uint64
+r_vlenb()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0xc22" : "=r" (x) );
+  return x;
+}
+
 // are device interrupts enabled?
 static inline int
 intr_get()
@@ -327,6 +397,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB's entries for one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// flush the TLB's entries for one page of one address space.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -334,6 +418,8 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
+#define MEGAPGSIZE (512*PGSIZE) // bytes per megapage (a level-1 leaf)
+#define GIGAPGSIZE (512*MEGAPGSIZE) // bytes per gigapage (a level-2 leaf)
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
@@ -343,7 +429,10 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
 #define PTE_CoW (1L << 8)
+#define PTE_S (1L << 9)   // swapped out; the PPN holds the swap slot
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,122 @@
+// Reader-writer spin locks.
+//
+// Any number of harts may hold the lock for reading at once,
+// or one for writing. A waiting writer keeps new readers out,
+// so a steady stream of lookups can't starve it. As with
+// spinlocks, interrupts are off while the lock is held.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "lockstat.h"
+#include "defs.h"
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+  lk->name = name;
+  lk->state = 0;
+  lk->cpu = 0;
+  lk->statid = lockclass(name, 0, 1);
+}
+
+static void
+count(struct rwlock *lk, uint64 start)
+{
+  struct lockcount *lc = mylockcount(lk->statid);
+
+  lc->acquires++;
+  if(start){
+    lc->contended++;
+    lc->waittime += r_time() - start;
+  }
+}
+
+void
+acquireread(struct rwlock *lk)
+{
+  uint64 start = 0;
+  uint s;
+
+  push_off();
+  if(lk->cpu == mycpu())
+    panic("acquireread");
+
+  for(;;){
+    s = __atomic_load_n(&lk->state, __ATOMIC_RELAXED);
+    if((s & (RW_WRITER|RW_WAITING)) == 0 &&
+       __atomic_compare_exchange_n(&lk->state, &s, s + 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+    if(start == 0)
+      start = r_time();
+  }
+  count(lk, start);
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+  if((lk->state & ~(RW_WRITER|RW_WAITING)) == 0)
+    panic("releaseread");
+  __atomic_fetch_sub(&lk->state, 1, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+void
+acquirewrite(struct rwlock *lk)
+{
+  uint64 start = 0;
+  uint s;
+
+  push_off();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+
+  for(;;){
+    s = __atomic_load_n(&lk->state, __ATOMIC_RELAXED);
+    // free, perhaps with other writers waiting: try to take it.
+    if((s & ~RW_WAITING) == 0 &&
+       __atomic_compare_exchange_n(&lk->state, &s, RW_WRITER, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+    // held: hold off new readers until we're in.
+    if((s & RW_WAITING) == 0)
+      __atomic_fetch_or(&lk->state, RW_WAITING, __ATOMIC_RELAXED);
+    if(start == 0)
+      start = r_time();
+  }
+
+  lk->cpu = mycpu();
+  count(lk, start);
+  lk->holdstart = r_time();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+
+  struct lockcount *lc = mylockcount(lk->statid);
+  uint64 hold = r_time() - lk->holdstart;
+  if(hold > lc->maxhold)
+    lc->maxhold = hold;
+
+  lk->cpu = 0;
+  // clears RW_WAITING too; waiting writers set it again.
+  __atomic_store_n(&lk->state, 0, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+// Is this cpu holding the lock for writing?
+// Interrupts must be off.
+int
+holdingwrite(struct rwlock *lk)
+{
+  return (lk->state & RW_WRITER) && lk->cpu == mycpu();
+}
@@ -0,0 +1,15 @@
+// Reader-writer spin lock.
+struct rwlock {
+  uint state;        // RW_WRITER, RW_WAITING, and the number of readers
+
+  // For debugging:
+  char *name;        // Name of lock.
+  struct cpu *cpu;   // The cpu holding it for writing.
+
+  // For lockstat:
+  int statid;
+  uint64 holdstart;  // when the writer acquired it
+};
+
+#define RW_WRITER  0x80000000  // held for writing
+#define RW_WAITING 0x40000000  // a writer is waiting; no new readers
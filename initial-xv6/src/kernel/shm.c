@@ -0,0 +1,189 @@
+//
+// Shared-memory segments: shm_open(), shm_attach(), shm_detach(),
+// shm_close().
+//
+// A segment is a set of physical pages that several processes
+// map at once, so that they can pass data without copying it.
+// shm_open() finds or creates the segment with a given key, and
+// shm_attach() maps all of it into the calling process as a
+// region like those of mmap() (see mmap.c), which fork() shares
+// with the child. shm_detach(), exit() and exec() unmap it.
+//
+// Each process's open of a segment, like each attachment, holds
+// a reference to it; shm_close() or exit() drops the open, which
+// a child made by fork() doesn't inherit. Pages are allocated on
+// first touch. They belong to the segment, not to the page
+// tables that map them, and are freed with it when its last
+// reference goes.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct shm {
+  int key;
+  int npages;                // size; 0 if this slot is free
+  int nref;                  // opens and attaching regions, in all processes
+  uint64 pages[NSHMPAGES];   // physical pages, 0 until first touched
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Find the segment with key, or create one of size bytes, and
+// count the current process's open of it, if it hasn't one yet.
+// Returns its id, or -1 if an existing segment is smaller than
+// size, or there is no free slot.
+int
+shmopen(int key, uint64 size)
+{
+  struct proc *p = myproc();
+  struct shm *s, *free = 0;
+  int id = -1;
+
+  if(size == 0 || size > NSHMPAGES * PGSIZE)
+    return -1;
+
+  acquire(&shmtab.lock);
+  for(s = shmtab.shm; s < &shmtab.shm[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+    } else if(s->key == key){
+      if(s->npages * PGSIZE >= size){
+        id = s - shmtab.shm;
+        if((p->shmopened & (1 << id)) == 0){
+          p->shmopened |= 1 << id;
+          s->nref++;
+        }
+      }
+      release(&shmtab.lock);
+      return id;
+    }
+  }
+  if(free){
+    free->key = key;
+    free->npages = PGROUNDUP(size) / PGSIZE;
+    free->nref = 1;
+    id = free - shmtab.shm;
+    p->shmopened |= 1 << id;
+  }
+  release(&shmtab.lock);
+  return id;
+}
+
+// Drop the current process's open of segment id.
+// Returns 0, or -1 if it has none.
+int
+shmclose(int id)
+{
+  struct proc *p = myproc();
+
+  if(id < 0 || id >= NSHM || (p->shmopened & (1 << id)) == 0)
+    return -1;
+  p->shmopened &= ~(1 << id);
+  shmput(&shmtab.shm[id]);
+  return 0;
+}
+
+// Drop every open of an exiting process.
+void
+shmexit(struct proc *p)
+{
+  for(int id = 0; id < NSHM; id++)
+    if(p->shmopened & (1 << id))
+      shmput(&shmtab.shm[id]);
+  p->shmopened = 0;
+}
+
+// Map segment id into the current process.
+// Returns the address, or -1.
+uint64
+shmattach(int id)
+{
+  struct shm *s;
+  uint64 addr;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtab.shm[id];
+
+  acquire(&shmtab.lock);
+  if(s->npages == 0){
+    release(&shmtab.lock);
+    return -1;
+  }
+  s->nref++;
+  release(&shmtab.lock);
+
+  // drop just the attachment: whoever opened s still holds it.
+  if((addr = mmapshm(s, s->npages * PGSIZE)) == -1)
+    shmput(s);
+  return addr;
+}
+
+// Unmap the segment attached at addr.
+int
+shmdetach(uint64 addr)
+{
+  struct proc *p = myproc();
+
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && v->shm && v->addr == addr)
+      return munmap(addr, v->len);
+  return -1;
+}
+
+// Another region maps s, in a child made by fork().
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  s->nref++;
+  release(&shmtab.lock);
+}
+
+// An open of s or a region mapping it has gone; free s with
+// the last one. Never sleeps.
+void
+shmput(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(--s->nref == 0){
+    for(int i = 0; i < s->npages; i++){
+      if(s->pages[i])
+        kfree((void *)s->pages[i]);
+      s->pages[i] = 0;
+    }
+    s->npages = 0;
+  }
+  release(&shmtab.lock);
+}
+
+// The physical address of page i of s, allocating it on the
+// first touch. Returns 0 if out of memory.
+uint64
+shmpage(struct shm *s, int i)
+{
+  uint64 pa;
+
+  acquire(&shmtab.lock);
+  if(s->pages[i] == 0)
+    s->pages[i] = (uint64)kalloc_zeroed();
+  pa = s->pages[i];
+  release(&shmtab.lock);
+  return pa;
+}
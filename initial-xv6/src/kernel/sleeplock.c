@@ -1,4 +1,11 @@
 // Sleeping locks
+//
+// An adaptive mutex: a process that finds the lock held spins
+// for a while if the owner is running on another hart, since
+// it will likely release soon and sleeping costs two context
+// switches. Otherwise it joins a FIFO queue and sleeps, and
+// releasesleep() hands ownership straight to the oldest waiter,
+// so only that one process wakes and waiters never race.
 
 #include "types.h"
 #include "riscv.h"
@@ -8,6 +15,16 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "lockstat.h"
+
+// how many times to re-check a lock whose owner is running
+// before sleeping; each check is about 64 reads of lk->locked.
+#define SPINMAX 100
+
+// wait and hold times are measured with the time CSR, as for
+// spinlocks; the harts' cycle counters wouldn't do here anyway,
+// since they don't agree, and a process may sleep on one hart
+// and wake on another, or release the lock on another.
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,17 +33,59 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+  lk->head = lk->tail = 0;
+  lk->statid = lockclass(name, 1, 1);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct proc *o;
+  uint64 start = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  if (lk->locked) {
+    start = r_time();
+    // spin while the owner runs, but not past queued
+    // waiters, so that the lock still goes in FIFO order.
+    for (int n = 0; n < SPINMAX && lk->locked && lk->head == 0; n++) {
+      o = lk->owner;
+      if (o == 0 || __atomic_load_n(&o->state, __ATOMIC_RELAXED) != RUNNING)
+        break;
+      release(&lk->lk);
+      for (int i = 0; i < 64 && __atomic_load_n(&lk->locked, __ATOMIC_RELAXED); i++)
+        ;
+      acquire(&lk->lk);
+    }
+  }
+
+  if (lk->locked) {
+    p->lknext = 0;
+    if (lk->tail)
+      lk->tail->lknext = p;
+    else
+      lk->head = p;
+    lk->tail = p;
+    // sleep until releasesleep() makes us the owner. other
+    // wakeups (kill) just send us back to sleep.
+    while (lk->owner != p)
+      sleep(&p->lknext, &lk->lk);
+  } else {
+    lk->locked = 1;
+    lk->owner = p;
+  }
+  lk->pid = p->pid;
+
+  // lk->lk is held, so interrupts are off.
+  struct lockcount *lc = mylockcount(lk->statid);
+  lk->holdstart = r_time();
+  lc->acquires++;
+  if (start) {
+    lc->contended++;
+    lc->waittime += lk->holdstart - start;
   }
-  lk->locked = 1;
-  lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
@@ -34,9 +93,25 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  struct lockcount *lc = mylockcount(lk->statid);
+  uint64 hold = r_time() - lk->holdstart;
+  if (hold > lc->maxhold)
+    lc->maxhold = hold;
+
+  struct proc *p = lk->head;
+  if (p) {
+    // hand the still-locked lock to the oldest waiter.
+    lk->head = p->lknext;
+    if (lk->head == 0)
+      lk->tail = 0;
+    lk->owner = p;
+    lk->pid = p->pid;
+    wakeproc(p, &p->lknext);
+  } else {
+    lk->locked = 0;
+    lk->owner = 0;
+    lk->pid = 0;
+  }
   release(&lk->lk);
 }
 
@@ -46,7 +121,7 @@ holdingsleep(struct sleeplock *lk)
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  r = lk->locked && (lk->owner == myproc());
   release(&lk->lk);
   return r;
 }
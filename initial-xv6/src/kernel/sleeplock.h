@@ -2,9 +2,16 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Process holding lock
+  struct proc *head;  // Waiters, oldest first, through proc.lknext
+  struct proc *tail;
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For lockstat:
+  int statid;        // lockclass() of name
+  uint64 holdstart;  // time CSR when acquired
 };
 
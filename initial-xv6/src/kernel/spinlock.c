@@ -6,15 +6,27 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
 void
 initlock(struct spinlock *lk, char *name)
+{
+  initlockid(lk, name, lockclass(name, 0, 1));
+}
+
+// initlock() for a lock made at run time, whose
+// class statid was looked up once with lockclass().
+void
+initlockid(struct spinlock *lk, char *name, int statid)
 {
   lk->name = name;
   // printf("here\n");
   lk->locked = 0;
+  lk->next = 0;
+  lk->serving = 0;
   lk->cpu = 0;
+  lk->statid = statid;
 }
 
 // Acquire the lock.
@@ -22,16 +34,36 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 start = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef LOCK_TICKET
+  // Take a ticket with a single amoadd.w, then wait for it to
+  // be served. Harts acquire in the order they arrived, and
+  // the waiters only read the lock's cache line until
+  // release() writes serving, instead of each hammering it
+  // with atomic swaps.
+  uint ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  if(__atomic_load_n(&lk->serving, __ATOMIC_RELAXED) != ticket){
+    start = r_time();
+    while(__atomic_load_n(&lk->serving, __ATOMIC_RELAXED) != ticket)
+      ;
+  }
+  lk->locked = 1;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    start = r_time();
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      ;
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -41,6 +73,14 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  struct lockcount *lc = mylockcount(lk->statid);
+  lk->holdstart = r_time();
+  lc->acquires++;
+  if(start){
+    lc->contended++;
+    lc->waittime += lk->holdstart - start;
+  }
 }
 
 // Release the lock.
@@ -50,6 +90,11 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  struct lockcount *lc = mylockcount(lk->statid);
+  uint64 hold = r_time() - lk->holdstart;
+  if(hold > lc->maxhold)
+    lc->maxhold = hold;
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -60,6 +105,12 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef LOCK_TICKET
+  // Only the holder writes serving, so a plain increment is
+  // safe; the store itself must be a single instruction.
+  lk->locked = 0;
+  __atomic_store_n(&lk->serving, lk->serving + 1, __ATOMIC_RELAXED);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -68,6 +119,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
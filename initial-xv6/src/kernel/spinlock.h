@@ -2,8 +2,17 @@
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // Ticket lock (make LOCK=TICKET): waiters take increasing
+  // tickets from next and enter in order as serving reaches them.
+  uint next;
+  uint serving;
+
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For lockstat:
+  int statid;        // lockclass() of name
+  uint64 holdstart;  // time CSR when acquired
 };
 
@@ -7,18 +7,31 @@
 void main();
 void timerinit();
 
-// entry.S needs one stack per CPU.
-__attribute__ ((aligned (16))) char stack0[4096 * NCPU];
+extern char end[]; // first address after kernel, from kernel.ld.
 
-// a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+// the device tree's physical address, from qemu via entry.S.
+uint64 bootdtb;
+
+// set if the harts implement the V (vector) extension;
+// misa is only readable in machine mode.
+int hasrvv;
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
 
-// entry.S jumps here in machine mode on stack0.
+// each hart's boot page, just past the kernel image. entry.S
+// puts the hart's stack at the top; timervec's scratch area
+// sits at the bottom. main() allocates nothing from this
+// region until it knows how many harts there are.
+uint64
+bootpage(int hartid)
+{
+  return PGROUNDUP((uint64)end) + hartid * PGSIZE;
+}
+
+// entry.S jumps here in machine mode on the hart's boot page.
 void
-start()
+start(uint64 dtb)
 {
   // set M Previous Privilege mode to Supervisor, for mret.
   unsigned long x = r_mstatus();
@@ -43,9 +56,17 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor mode read the cycle counter and the time,
+  // for lockstat.
+  w_mcounteren(r_mcounteren() | 1 | 2);
+
   // ask for clock interrupts.
   timerinit();
 
+  if(r_misa() & MISA_V)
+    hasrvv = 1;
+  bootdtb = dtb;
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -73,7 +94,7 @@ timerinit()
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
   // scratch[4] : desired interval (in cycles) between timer interrupts.
-  uint64 *scratch = &timer_scratch[id][0];
+  uint64 *scratch = (uint64*)bootpage(id);
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
   w_mscratch((uint64)scratch);
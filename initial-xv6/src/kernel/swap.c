@@ -0,0 +1,475 @@
+//
+// Swapping: when memory runs low, user pages are written out
+// to a swap area on the disk, and read back in when they are
+// next touched.
+//
+// The swap area is the SWAPSIZE blocks just past the file
+// system on the same disk (mkfs makes fs.img that much longer),
+// cut into page-sized slots. A swapped-out page's PTE has PTE_V
+// clear and PTE_S set, keeps its other permission bits, and
+// holds the slot number in place of the physical page number.
+// fork() shares slots, so each has a reference count.
+//
+// A page is first offered to a pool in RAM instead, as zram
+// does: compressed with lzcompress(), it is kept if it shrinks
+// to half a page or less, and the pool has a free slot. Pool
+// slots are numbered after the disk's, and reading one back in
+// takes no I/O. Pages that don't compress well, or don't fit,
+// go to the disk. ZRAM=0 builds without the pool.
+//
+// The pool packs compressed pages into whole pages of its own,
+// in 64-byte units, one bit each in the page's map, and gives
+// a page back to kalloc() as soon as nothing in it is in use.
+//
+// Clean pages of the page cache (pcache.c) that no process maps
+// cost nothing to drop, so the reclaimer takes those first.
+//
+// The reclaimer is a clock: a hand sweeps over physical memory,
+// and a page whose accessed bit (PTE_A) is set gets a second
+// chance, with the bit cleared, before it is evicted. It finds
+// the PTE that maps a page through a reverse map, rmap[], set
+// when a private page is mapped into a process. An entry may be
+// stale, so it is checked against the page table before use.
+//
+// fork() leaves rmap[] naming the parent for the pages it
+// shares. When the parent has copied such a page or exited,
+// the child keeps it at the same address, so an entry whose
+// process no longer maps the page is looked up again among
+// all processes there.
+//
+// Only pages with one reference are evicted, and only from a
+// process that isn't in the middle of using them in the kernel:
+// one preempted in usertrap(), the current process at the safe
+// points where usertrap() calls swapcheck(), or one asleep.
+// A process asleep in a system call that will copy to or from
+// user memory under a spinlock when it wakes, when reading a
+// page back in can't sleep, keeps the pages it named to
+// uvmprefault(), which are pinned until the call returns.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "vmstat.h"
+#include "defs.h"
+
+#define NSLOTS    (SWAPSIZE / (PGSIZE / BSIZE))
+#define ZMAXLEN   (PGSIZE / 2)   // largest compressed page kept in RAM
+#define SWAPLOW   64   // reclaim when fewer pages than this are free
+#define SWAPBATCH 32   // pages to reclaim at a time
+#define ZUNIT     64   // bytes per unit of a pool page
+
+#define SLOT(pte) ((pte) >> 10)
+#define SWAPPTE(slot, flags) (((uint64)(slot) << 10) | ((flags) & ~PTE_V) | PTE_S)
+
+extern struct vmstat vmstat;
+
+// which process maps a physical page, and where.
+struct rmap {
+  struct proc *p;
+  uint64 va;
+};
+
+static struct rmap *rmap;   // by PAGE_INDEX()
+
+// slots 0 .. NSLOTS-1 are on the disk, NSLOTS .. NSLOTS+NZRAM-1
+// in the compressed pool.
+struct {
+  struct spinlock lock;
+  uchar ref[NSLOTS + NZRAM];   // PTEs holding each slot; 0 if free
+  int next[2];                 // where to look for a free one, by kind
+  char *zdata[NZRAM];          // compressed pages, in the pool
+  ushort zlen[NZRAM];          // and their lengths
+} slots;
+
+// the pool's pages: no more than one per compressed page.
+// map has bit i set if the ZUNIT bytes at pa + i*ZUNIT are in
+// use. protected by slots.lock.
+struct zpage {
+  char *pa;                    // 0 if this entry is free
+  uint64 map;
+};
+static struct zpage zpages[NZRAM];
+
+// held across each page's disk I/O, so that a page being
+// written out can't be read back in before all of it is
+// there. it also protects hand and swapbuf.
+static struct sleeplock swaplock;
+static uint64 hand;         // the clock's next page, by PAGE_INDEX()
+static struct buf swapbuf[PGSIZE / BSIZE];
+#ifndef NOZRAM
+static char zbuf[ZMAXLEN];  // lzcompress() output
+#endif
+
+// Must precede kinit(), for bootalloc().
+void
+swapinit(void)
+{
+  initlock(&slots.lock, "swapslots");
+  initsleeplock(&swaplock, "swap");
+  rmap = bootalloc(PAGE_COUNT * sizeof(struct rmap));
+}
+
+// Record that the private page at pa is mapped at va in p.
+void
+rmapset(void *pa, struct proc *p, uint64 va)
+{
+  struct rmap *r = &rmap[PAGE_INDEX(pa)];
+
+  r->p = p;
+  r->va = va;
+}
+
+// take a free slot on the disk, or in the pool if zram is set.
+static int
+slotalloc(int zram)
+{
+  int first = zram ? NSLOTS : 0;
+  int n = zram ? NZRAM : NSLOTS;
+
+  acquire(&slots.lock);
+  for(int i = 0; i < n; i++){
+    int s = first + (slots.next[zram] + i) % n;
+    if(slots.ref[s] == 0){
+      slots.ref[s] = 1;
+      slots.next[zram] = s - first + 1;
+      release(&slots.lock);
+      return s;
+    }
+  }
+  release(&slots.lock);
+  return -1;
+}
+
+// the units of the pool that n bytes take, as a map.
+static uint64
+zunits(int n)
+{
+  int k = (n + ZUNIT - 1) / ZUNIT;
+
+  return k == 64 ? ~0UL : (1UL << k) - 1;
+}
+
+#ifndef NOZRAM
+// Find room for n bytes in the pool, in a page it has or a new
+// one. Returns 0 if out of memory. slots.lock must be held.
+static char *
+zalloc(int n)
+{
+  uint64 m = zunits(n);
+  int k = __builtin_popcountl(m);
+  struct zpage *free = 0;
+
+  for(struct zpage *z = zpages; z < &zpages[NZRAM]; z++){
+    if(z->pa == 0){
+      if(free == 0)
+        free = z;
+      continue;
+    }
+    if(64 - __builtin_popcountl(z->map) < k)
+      continue;
+    for(int i = 0; i + k <= 64; i++){
+      if((z->map & (m << i)) == 0){
+        z->map |= m << i;
+        return z->pa + i * ZUNIT;
+      }
+    }
+  }
+  if(free == 0 || (free->pa = kalloc()) == 0)
+    return 0;
+  free->map = m;
+  __atomic_fetch_add(&vmstat.zrambytes, PGSIZE, __ATOMIC_RELAXED);
+  return free->pa;
+}
+#endif
+
+// Give back the n bytes at data to the pool, and the page they
+// are in to kalloc() if that leaves it empty. slots.lock must
+// be held.
+static void
+zfree(char *data, int n)
+{
+  char *pa = (char *)PGROUNDDOWN((uint64)data);
+
+  for(struct zpage *z = zpages; z < &zpages[NZRAM]; z++){
+    if(z->pa != pa)
+      continue;
+    z->map &= ~(zunits(n) << ((data - pa) / ZUNIT));
+    if(z->map == 0){
+      kfree(pa);
+      z->pa = 0;
+      __atomic_fetch_sub(&vmstat.zrambytes, PGSIZE, __ATOMIC_RELAXED);
+    }
+    return;
+  }
+  panic("zfree");
+}
+
+// A PTE holding the swapped-out page in pte has gone.
+// Never sleeps.
+void
+swapfree(pte_t pte)
+{
+  int s = SLOT(pte);
+
+  acquire(&slots.lock);
+  if(slots.ref[s] == 0)
+    panic("swapfree");
+  if(--slots.ref[s] == 0 && s >= NSLOTS){
+    zfree(slots.zdata[s - NSLOTS], slots.zlen[s - NSLOTS]);
+    __atomic_fetch_sub(&vmstat.zrampages, 1, __ATOMIC_RELAXED);
+    slots.zdata[s - NSLOTS] = 0;
+  }
+  release(&slots.lock);
+}
+
+// Give pagetable the swapped-out page in pte at va too,
+// for fork(). Returns -1 if out of memory.
+int
+swapfork(pagetable_t pagetable, uint64 va, pte_t pte)
+{
+  pte_t *npte;
+
+  if((npte = walk(pagetable, va, 1)) == 0)
+    return -1;
+  *npte = pte;
+  acquire(&slots.lock);
+  slots.ref[SLOT(pte)]++;
+  release(&slots.lock);
+  return 0;
+}
+
+// Read or write the page at pa from or to slot s.
+// swaplock must be held.
+static void
+swapio(int s, char *pa, int write)
+{
+  for(int i = 0; i < PGSIZE / BSIZE; i++){
+    struct buf *b = &swapbuf[i];
+    b->blockno = FSSIZE + s * (PGSIZE / BSIZE) + i;
+    if(write)
+      memmove(b->data, pa + i * BSIZE, BSIZE);
+    virtio_disk_rw(b, write);
+    if(!write)
+      memmove(pa + i * BSIZE, b->data, BSIZE);
+  }
+}
+
+// Is p, whose lock is held, out of the way of the swapper:
+// not running, except at swapcheck(), or in the middle of
+// using its pages in the kernel?
+static int
+quiet(struct proc *p)
+{
+  return p == myproc() || p->state == SLEEPING ||
+         (p->state == RUNNABLE && p->inuser);
+}
+
+// The PTE with which quiet process p maps the page at pa at
+// va, or 0. p->lock must be held.
+static pte_t *
+rmapped(struct proc *p, uint64 va, uint64 pa)
+{
+  pte_t *pte;
+  int mega;
+
+  if(p->pagetable == 0 || va >= p->sz)
+    return 0;
+  pte = leafpte(p->pagetable, va, &mega);
+  if(pte == 0 || mega || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) || PTE2PA(*pte) != pa)
+    return 0;
+  return pte;
+}
+
+// Find the quiet process that maps the page at pa at va, for
+// a stale rmap[] entry. Returns it locked, or 0.
+static struct proc *
+rmapfind(uint64 va, uint64 pa)
+{
+  for(struct proc *p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(quiet(p) && rmapped(p, va, pa))
+      return p;
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// Try to keep the page at pa compressed in the pool.
+// Returns its slot, or -1. swaplock must be held, for zbuf.
+static int
+zramstore(char *pa)
+{
+#ifdef NOZRAM
+  return -1;
+#else
+  int n, s;
+  char *data;
+
+  if((n = lzcompress(pa, PGSIZE, zbuf, ZMAXLEN)) < 0){
+    __atomic_fetch_add(&vmstat.zramreject, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  if((s = slotalloc(1)) < 0)
+    return -1;
+  acquire(&slots.lock);
+  if((data = zalloc(n)) == 0){
+    // out of memory: give the slot back, unused.
+    slots.ref[s] = 0;
+    release(&slots.lock);
+    return -1;
+  }
+  slots.zdata[s - NSLOTS] = data;
+  slots.zlen[s - NSLOTS] = n;
+  release(&slots.lock);
+  memmove(data, zbuf, n);
+  __atomic_fetch_add(&vmstat.zramout, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&vmstat.zrampages, 1, __ATOMIC_RELAXED);
+  return s;
+#endif
+}
+
+// Consider the page at pa for eviction. Returns 1 if it was
+// evicted, 0 if not, and -1 if there is no free slot.
+// swaplock must be held.
+static int
+evict(uint64 pa)
+{
+  struct rmap *r = &rmap[PAGE_INDEX(pa)];
+  struct proc *p = r->p;
+  uint64 va = r->va;
+  pte_t *pte;
+  int s;
+
+  if(p == 0)
+    return 0;
+#ifdef COW
+  // shared; checked again below, where it can't change.
+  if(krefget((void *)pa) != 1)
+    return 0;
+#endif
+  acquire(&p->lock);
+  if(!quiet(p) && p->state != UNUSED){
+    release(&p->lock);
+    return 0;
+  }
+  if((pte = rmapped(p, va, pa)) == 0){
+    release(&p->lock);
+    if((p = rmapfind(va, pa)) == 0)
+      return 0;
+    r->p = p;
+    pte = rmapped(p, va, pa);
+  }
+  // pinned by uvmprefault() for the system call p is in.
+  if(va < p->pinva + p->pinlen && va + PGSIZE > p->pinva){
+    release(&p->lock);
+    return 0;
+  }
+#ifdef COW
+  // only p maps it, and p can't fork() while quiet.
+  if(krefget((void *)pa) != 1){
+    release(&p->lock);
+    return 0;
+  }
+#endif
+  // used since the hand last passed: a second chance.
+  // p is not running, but a TLB may still hold the old
+  // PTE under p's ASID: p flushes it before it next runs.
+  if(*pte & PTE_A){
+    *pte &= ~PTE_A;
+    p->tlbstale = 1;
+    release(&p->lock);
+    return 0;
+  }
+  if((s = zramstore((char *)pa)) < 0 && (s = slotalloc(0)) < 0){
+    release(&p->lock);
+    return -1;
+  }
+  *pte = SWAPPTE(s, PTE_FLAGS(*pte) & ~(PTE_A|PTE_D));
+  p->tlbstale = 1;
+  r->p = 0;
+  release(&p->lock);
+
+  if(s < NSLOTS){
+    // a fault on the page now waits for swaplock, and so
+    // for the write to finish.
+    swapio(s, (char *)pa, 1);
+    __atomic_fetch_add(&vmstat.swapout, 1, __ATOMIC_RELAXED);
+  }
+  kfree((void *)pa);
+  return 1;
+}
+
+// Free up to n pages: unmapped ones from the page cache, then
+// by eviction, sweeping physical memory at most twice. Returns
+// how many were freed. Sleeps, so the caller must hold no locks.
+int
+swapreclaim(int n)
+{
+  int done;
+
+  if((done = pcacheshrink(n)) == n)
+    return done;
+  acquiresleep(&swaplock);
+  for(uint64 i = 0; i < 2 * PAGE_COUNT && done < n; i++){
+    uint64 pa = KERNBASE + hand * PGSIZE;
+    hand = (hand + 1) % PAGE_COUNT;
+    int r = evict(pa);
+    if(r < 0)
+      break;
+    done += r;
+  }
+  releasesleep(&swaplock);
+  return done;
+}
+
+// Called by usertrap() where the current process holds no
+// locks and none of its pages: if memory is low, reclaim some.
+void
+swapcheck(void)
+{
+  if(kfreepages() < SWAPLOW)
+    swapreclaim(SWAPBATCH);
+}
+
+// Read the swapped-out page at va back in; pte is its PTE in
+// the current process's page table. Returns the page's
+// physical address, or 0 if out of memory.
+uint64
+swapin(pagetable_t pagetable, uint64 va, pte_t *pte)
+{
+  pte_t old = *pte;
+  int s = SLOT(old);
+  // the time CSR, since the process may sleep on one hart and
+  // go on on another, whose cycle counter doesn't agree.
+  uint64 t0 = r_time();
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  if(s >= NSLOTS){
+    // our reference keeps the compressed copy, which
+    // no one changes, so it needs no lock.
+    if(lzdecompress(slots.zdata[s - NSLOTS], slots.zlen[s - NSLOTS], mem, PGSIZE) != PGSIZE)
+      panic("swapin: zram");
+    __atomic_fetch_add(&vmstat.zramin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&vmstat.zramtime, r_time() - t0, __ATOMIC_RELAXED);
+  } else {
+    acquiresleep(&swaplock);
+    swapio(s, mem, 0);
+    releasesleep(&swaplock);
+    __atomic_fetch_add(&vmstat.swapin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&vmstat.swaptime, r_time() - t0, __ATOMIC_RELAXED);
+  }
+
+  *pte = PA2PTE(mem) | (PTE_FLAGS(old) & ~PTE_S) | PTE_V;
+  swapfree(old);
+  rmapset(mem, myproc(), PGROUNDDOWN(va));
+  return (uint64)mem;
+}
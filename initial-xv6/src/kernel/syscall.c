@@ -104,6 +104,14 @@ extern uint64 sys_close(void);
 extern uint64 sys_waitx(void);
 extern uint64 sys_getreadcount(void);
 extern uint64 sys_set_priority(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_vmstat(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_shm_open(void);
+extern uint64 sys_shm_attach(void);
+extern uint64 sys_shm_detach(void);
+extern uint64 sys_shm_close(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -131,7 +139,15 @@ static uint64 (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_waitx]   sys_waitx,
 [SYS_getreadcount] sys_getreadcount,
-[SYS_set_priority]  sys_set_priority
+[SYS_set_priority]  sys_set_priority,
+[SYS_lockstat] sys_lockstat,
+[SYS_vmstat]  sys_vmstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shm_open]   sys_shm_open,
+[SYS_shm_attach] sys_shm_attach,
+[SYS_shm_detach] sys_shm_detach,
+[SYS_shm_close]  sys_shm_close,
 };
 
 void
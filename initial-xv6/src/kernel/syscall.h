@@ -23,3 +23,11 @@
 #define SYS_waitx  22
 #define SYS_getreadcount 23
 #define SYS_set_priority 24
+#define SYS_lockstat 25
+#define SYS_vmstat 26
+#define SYS_mmap 27
+#define SYS_munmap 28
+#define SYS_shm_open 29
+#define SYS_shm_attach 30
+#define SYS_shm_detach 31
+#define SYS_shm_close 32
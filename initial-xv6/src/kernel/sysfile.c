@@ -86,6 +86,8 @@ sys_read(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
+  if(n > 0)
+    uvmprefault(p, n);
   return fileread(f, p, n);
 }
 
@@ -100,6 +102,8 @@ sys_write(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
+  if(n > 0)
+    uvmprefault(p, n);
 
   return filewrite(f, p, n);
 }
@@ -229,6 +233,7 @@ sys_unlink(void)
     goto bad;
   }
 
+  dcachedel(dp, name);
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
@@ -444,14 +449,18 @@ sys_chdir(void)
 uint64
 sys_exec(void)
 {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  int i, n;
   uint64 uargv, uarg;
 
   argaddr(1, &uargv);
   if(argstr(0, path, MAXPATH) < 0) {
     return -1;
   }
+  // fetch each string into buf, then keep just
+  // as much of it as it needs.
+  if((buf = kalloc()) == 0)
+    return -1;
   memset(argv, 0, sizeof(argv));
   for(i=0;; i++){
     if(i >= NELEM(argv)){
@@ -464,23 +473,26 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
-    if(argv[i] == 0)
+    if((n = fetchstr(uarg, buf, PGSIZE)) < 0)
       goto bad;
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0)
+    argv[i] = kmalloc(n + 1);
+    if(argv[i] == 0)
       goto bad;
+    memmove(argv[i], buf, n + 1);
   }
+  kfree(buf);
 
   int ret = exec(path, argv);
 
   for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+    kfree_obj(argv[i]);
 
   return ret;
 
  bad:
+  kfree(buf);
   for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+    kfree_obj(argv[i]);
   return -1;
 }
 
@@ -513,3 +525,31 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// mmap(addr, len, prot, flags, fd, off). The kernel picks the
+// address; addr is ignored.
+uint64
+sys_mmap(void)
+{
+  uint64 len, off;
+  int prot, flags;
+  struct file *f;
+
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argaddr(5, &off);
+  if(argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
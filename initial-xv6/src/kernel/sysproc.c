@@ -5,6 +5,9 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "vmstat.h"
+
+extern struct vmstat vmstat;
 
 extern struct proc proc[NPROC];
 
@@ -36,6 +39,8 @@ sys_wait(void)
 {
   uint64 p;
   argaddr(0, &p);
+  if (p)
+    uvmprefault(p, sizeof(int));
   return wait(p);
 }
 
@@ -104,6 +109,8 @@ sys_waitx(void)
   argaddr(0, &addr);
   argaddr(1, &addr1); // user virtual memory
   argaddr(2, &addr2);
+  if (addr)
+    uvmprefault(addr, sizeof(int));
   int ret = waitx(addr, &wtime, &rtime);
   struct proc *p = myproc();
   if (copyout(p->pagetable, addr1, (char *)&wtime, sizeof(int)) < 0)
@@ -178,11 +185,80 @@ uint64
 sys_sigreturn(void)
 {
   struct proc* p = myproc();
-  memmove(p->trapframe, p->alarm_tf, PGSIZE);
+  if(p->alarm_tf == 0)
+    return -1;
+  *p->trapframe = *p->alarm_tf;
 
-  kfree(p->alarm_tf);
+  kfree_obj(p->alarm_tf);
   p->alarm_tf=0;
   p->alarm_fire=0;
   p->curr_ticks=0;
   return p->trapframe->a0;
-}
\ No newline at end of file
+}
+
+// copy up to n lock statistics records to the user buffer;
+// a null buffer resets the counters instead.
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(addr == 0){
+    lockstatreset();
+    return 0;
+  }
+  if(n < 0)
+    return -1;
+  return lockstatread(addr, n);
+}
+
+uint64
+sys_vmstat(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  vmstat.totalpages = PAGE_COUNT;
+  return copyout(myproc()->pagetable, addr, (char *)&vmstat, sizeof(vmstat));
+}
+
+uint64
+sys_shm_open(void)
+{
+  int key;
+  uint64 size;
+
+  argint(0, &key);
+  argaddr(1, &size);
+  return shmopen(key, size);
+}
+
+uint64
+sys_shm_attach(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmattach(id);
+}
+
+uint64
+sys_shm_detach(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shmdetach(addr);
+}
+
+uint64
+sys_shm_close(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmclose(id);
+}
@@ -5,14 +5,12 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vmstat.h"
 
 struct spinlock tickslock;
 uint ticks;
 
-#ifdef COW
-extern struct cow_info page_details[];
-extern struct spinlock page_cow_lock;
-#endif
+struct vmstat vmstat;
 
 extern char trampoline[], uservec[], userret[];
 
@@ -21,9 +19,25 @@ void kernelvec();
 
 extern int devintr();
 
+// bytes per vector register, or 0 without the V extension.
+uint64 vlenb;
+
 void trapinit(void)
 {
   initlock(&tickslock, "time");
+
+  if (hasrvv)
+  {
+    vec_on();
+    vlenb = r_vlenb();
+    vec_off();
+    // vecsave() keeps v0..v31 in a single page.
+    if (32 * vlenb > PGSIZE)
+    {
+      printf("trapinit: VLEN %d too large, vector unit disabled\n", (int)(8 * vlenb));
+      vlenb = 0;
+    }
+  }
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -49,6 +63,19 @@ void usertrap(void)
 
   struct proc *p = myproc();
 
+  // note whether user code wrote the f registers since they
+  // were last saved; sched() saves them before another process
+  // can use this hart's FPU. the kernel itself runs with the
+  // FPU off.
+  uint64 fs = r_sstatus() & SSTATUS_FS;
+  if (fs == SSTATUS_FS_DIRTY)
+    p->fpdirty = 1;
+  fpu_off();
+  uint64 vs = r_sstatus() & SSTATUS_VS;
+  if (vs == SSTATUS_VS_DIRTY)
+    p->vecdirty = 1;
+  vec_off();
+
   // save user program counter.
   p->trapframe->epc = r_sepc();
 
@@ -67,31 +94,62 @@ void usertrap(void)
     // so enable only now that we're done with those registers.
     intr_on();
 
+    swapcheck();
     syscall();
+    p->pinlen = 0;
   }
   else if ((which_dev = devintr()) != 0)
   {
     // ok
   }
-  else if (r_scause() == 15) {
-    // page fault
-    if(r_stval() >= MAXVA){
-      printf("usertrap()22: unexpected scause %p pid=%d\n", r_scause(), p->pid);
-      printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
+  else if (r_scause() == 2 && fs == SSTATUS_FS_OFF && !p->fpused)
+  {
+    // illegal instruction with the FPU off: almost certainly
+    // the process's first floating-point instruction. turn
+    // the FPU on for it from now on and retry the instruction.
+    // a truly illegal instruction traps again with the FPU on,
+    // and is killed below.
+    p->fpused = 1;
+  }
+  else if (r_scause() == 2 && vs == SSTATUS_VS_OFF && !p->vecused && vlenb)
+  {
+    // likewise for the first vector instruction. an FP-looking
+    // instruction may get here after the FPU was turned on for
+    // it above; that's fine, it just takes one more trap.
+    if ((p->vecstate.regs = kalloc_zeroed()) == 0)
       setkilled(p);
-    }
-    else{
-      pte_t* pte;
-      if(r_stval()==0){
-        setkilled(p);
-      }
-      pte = walk(p->pagetable, r_stval(), 0);
-      if(pte==0){
+    else
+      p->vecused = 1;
+  }
+  else if (r_scause() == 13 || r_scause() == 15)
+  {
+    // load or store page fault: a heap or mmap() page not
+    // backed yet, a store to a copy-on-write page, or the first
+    // store to a page of a shared mapping.
+    uint64 va = r_stval();
+    int write = r_scause() == 15;
+    swapcheck();
+    pte_t *pte = va < MAXVA ? leafpte(p->pagetable, va, 0) : 0;
+
+    if (pte == 0 || (*pte & PTE_V) == 0)
+    {
+      // if that failed for want of memory (a page, and up to two
+      // page-table pages to map it), rather than at an address
+      // that isn't the process's, swap some out, and try again.
+      if (uvmlazy(p->pagetable, va, write) == 0 &&
+          (kfreepages() >= 3 || swapreclaim(1) == 0 ||
+           uvmlazy(p->pagetable, va, write) == 0))
         setkilled(p);
-      }
-      if(pagefault(r_stval(), pte, p->pagetable))
+    }
+    else if (r_scause() == 13)
+      setkilled(p);
+    else if (*pte & PTE_CoW)
+    {
+      if (pagefault(va, pte, p->pagetable))
         setkilled(p);
     }
+    else if (mmapwrite(p, va, pte) < 0)
+      setkilled(p);
   }
   else
   {
@@ -103,6 +161,10 @@ void usertrap(void)
   if (killed(p))
     exit(-1);
 
+  // while it waits to run again, nothing in the kernel holds
+  // its pages, so the swapper may take them; see swap.c.
+  p->inuser = 1;
+
   // give up the CPU if this is a timer interrupt.
   #ifndef FCFS
   if (which_dev == 2)
@@ -140,10 +202,64 @@ void usertrap(void)
 #endif
 #endif
   }
+  p->inuser = 0;
   usertrapret();
   
 }
 
+// Save p's f registers if user code wrote them since they were
+// last saved. p must be the process running on this hart, with
+// interrupts off so that it can't move to another hart meanwhile.
+void fpusave(struct proc *p)
+{
+  if (!p->fpdirty)
+    return;
+  fpu_on();
+  fpsave(&p->fpstate);
+  fpu_off();
+  p->fpdirty = 0;
+}
+
+// Make sure this hart's f registers hold p's state. They usually
+// still do, unless another process used the FPU here or p last
+// ran on a different hart. Interrupts must be off.
+static void fpuload(struct proc *p)
+{
+  struct cpu *c = mycpu();
+
+  if (c->fpowner == p && p->fpcpu == c)
+    return;
+  fpu_on();
+  fprestore(&p->fpstate);
+  fpu_off();
+  c->fpowner = p;
+  p->fpcpu = c;
+}
+
+// Vector counterparts of fpusave() and fpuload().
+void vecusave(struct proc *p)
+{
+  if (!p->vecdirty)
+    return;
+  vec_on();
+  vecsave(&p->vecstate);
+  vec_off();
+  p->vecdirty = 0;
+}
+
+static void vecload(struct proc *p)
+{
+  struct cpu *c = mycpu();
+
+  if (c->vecowner == p && p->veccpu == c)
+    return;
+  vec_on();
+  vecrestore(&p->vecstate);
+  vec_off();
+  c->vecowner = p;
+  p->veccpu = c;
+}
+
 //
 // return to user space
 //
@@ -156,6 +272,13 @@ void usertrapret(void)
   // we're back in user space, where usertrap() is correct.
   intr_off();
 
+  // processes that never used the FPU return with it off,
+  // and pay nothing for floating-point state.
+  if (p->fpused)
+    fpuload(p);
+  if (p->vecused)
+    vecload(p);
+
   // send syscalls, interrupts, and exceptions to uservec in trampoline.S
   uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
   w_stvec(trampoline_uservec);
@@ -174,13 +297,19 @@ void usertrapret(void)
   unsigned long x = r_sstatus();
   x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE; // enable interrupts in user mode
+  x &= ~SSTATUS_FS;
+  if (p->fpused)
+    x |= SSTATUS_FS_CLEAN; // a write will mark it dirty
+  x &= ~SSTATUS_VS;
+  if (p->vecused)
+    x |= SSTATUS_VS_CLEAN;
   w_sstatus(x);
 
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = asidsatp(p);
 
   // jump to userret in trampoline.S at the top of memory, which
   // switches to the user page table, restores user registers,
@@ -372,13 +501,28 @@ int pagefault(uint64 va, pte_t* pte, pagetable_t pagetable)
   {
     flags |= PTE_W ;
     flags &= (~PTE_CoW);
+    // the other sharers have all copied the page or
+    // gone away: it is ours, so just make it writable.
+    // nothing can take a new reference meanwhile, since
+    // only this process maps it and it is here, not in fork().
+    if (krefget((void *)pa) == 1)
+    {
+      *pte = PA2PTE(pa) | flags;
+      tlbflush(pagetable, PGROUNDDOWN(va));
+      rmapset((void *)pa, myproc(), PGROUNDDOWN(va));
+      __atomic_fetch_add(&vmstat.cowreuse, 1, __ATOMIC_RELAXED);
+      return 0;
+    }
     char *mem = kalloc();
     if (mem == 0)
       return 1;
     memmove(mem, (void *)pa, PGSIZE);
     *pte = PA2PTE(mem) | flags;
+    tlbflush(pagetable, PGROUNDDOWN(va));
     kfree((void *)pa);
+    rmapset(mem, myproc(), PGROUNDDOWN(va));
+    __atomic_fetch_add(&vmstat.cowcopy, 1, __ATOMIC_RELAXED);
     return 0;
   }
-  return 0;
+  return 1;
 }
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "vmstat.h"
+
+extern struct vmstat vmstat;
 
 /*
  * the kernel's page table.
@@ -15,14 +20,31 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// kernel page table mappings made by kvmmap(), for the boot report.
+static int kvmmega, kvmsmall;
+
+#define MEGAORDER 9  // alloc_pages() order of a megapage
+
+// a valid PTE that maps memory, rather than pointing
+// to the next level of page table.
+#define ISLEAF(pte) ((pte) & (PTE_R|PTE_W|PTE_X))
+
+static int demote(pte_t *, char *);
+
+#ifdef COW
+// a page of zeros, mapped read-only and copy-on-write wherever
+// an untouched heap page is read. it keeps the reference from
+// kalloc() for good, so it is never reused or freed.
+static char *zeropage;
+#endif
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -30,14 +52,14 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
-  // PLIC
-  kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
+  // PLIC, up to the last hart's context
+  kvmmap(kpgtbl, PLIC, PLIC, PGROUNDUP(PLIC_MPRIORITY(ncpu) - PLIC), PTE_R | PTE_W);
 
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
-  kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
+  kvmmap(kpgtbl, (uint64)etext, (uint64)etext, phystop-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
@@ -49,11 +71,32 @@ kvmmake(void)
   return kpgtbl;
 }
 
+// number of page-table pages under pagetable, itself included.
+static int
+ptpages(pagetable_t pagetable)
+{
+  int n = 1;
+
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0)
+      n += ptpages((pagetable_t)PTE2PA(pte));
+  }
+  return n;
+}
+
 // Initialize the one kernel_pagetable
 void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  // each megapage stands in for a page of 512 4KB PTEs.
+  printf("kvm: %d 2MB + %d 4KB mappings, %d page-table pages (%d saved)\n",
+         kvmmega, kvmsmall, ptpages(kernel_pagetable), kvmmega);
+#ifdef COW
+  if((zeropage = kalloc_zeroed()) == 0)
+    panic("kvminit: zeropage");
+#endif
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -64,7 +107,7 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
-  w_satp(MAKE_SATP(kernel_pagetable));
+  w_satp(MAKE_SATP(kernel_pagetable, 0));
 
   // flush stale entries from the TLB.
   sfence_vma();
@@ -91,48 +134,169 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      // a megapage has no level-0 PTE. a lookup leaves it be,
+      // so that it never allocates; callers about to change
+      // PTEs call uvmsplit() first. with alloc, it is split.
+      if(ISLEAF(*pte) && (level != 1 || !alloc || demote(pte, 0) < 0))
+        return 0;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Return the level-1 PTE for va: a megapage, a pointer to a
+// level-0 page-table page, or invalid. Returns 0 if there is
+// no level-1 page-table page for va.
+static pte_t *
+walkl1(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if((*pte & PTE_V) == 0)
+    return 0;
+  return &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+}
+
+// Return the PTE that maps va, a megapage (*mega set to 1)
+// or a 4KB page, without allocating or splitting anything.
+// Returns 0 if there is none.
+pte_t *
+leafpte(pagetable_t pagetable, uint64 va, int *mega)
+{
+  pte_t *pte = walkl1(pagetable, va);
+
+  if(mega)
+    *mega = 0;
+  if(pte == 0 || (*pte & PTE_V) == 0)
+    return 0;
+  if(ISLEAF(*pte)){
+    if(mega)
+      *mega = 1;
+    return pte;
+  }
+  return &((pagetable_t)PTE2PA(*pte))[PX(0, va)];
+}
+
+// Replace the megapage PTE *l1 with a level-0 page-table page
+// of 512 PTEs that map the same memory with the same flags.
+// table is the page to use, or 0 to allocate one; a page from
+// inside the megapage itself is left unmapped. Returns -1 if
+// out of memory.
+static int
+demote(pte_t *l1, char *table)
+{
+  uint64 pa = PTE2PA(*l1);
+  uint flags = PTE_FLAGS(*l1);
+  pagetable_t pt;
+
+  if(table == 0 && (table = kalloc()) == 0)
+    return -1;
+  pt = (pagetable_t)table;
+  for(int i = 0; i < 512; i++){
+    uint64 a = pa + i*PGSIZE;
+    pt[i] = a == (uint64)table ? 0 : PA2PTE(a) | flags;
+  }
+  *l1 = PA2PTE(pt) | PTE_V;
+  __atomic_fetch_add(&vmstat.megasplit, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+// Split the megapage that maps va, if there is one, into
+// 4KB pages. Returns -1 if out of memory.
+int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pte_t *l1 = walkl1(pagetable, va);
+
+  if(l1 && (*l1 & PTE_V) && ISLEAF(*l1))
+    return demote(l1, 0);
+  return 0;
+}
+
 // Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// or 0 if not mapped. A heap page that sbrk() has not yet
+// backed is mapped now, to the zero page; a caller that
+// writes must break the copy-on-write, as copyout() does.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int mega;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
-  if(pte == 0)
-    return 0;
-  if((*pte & PTE_V) == 0)
-    return 0;
+  pte = leafpte(pagetable, va, &mega);
+  if(pte == 0 || (*pte & PTE_V) == 0)
+    return uvmlazy(pagetable, va, 0);
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(mega)
+    pa += PGROUNDDOWN(va) % MEGAPGSIZE;
   return pa;
 }
 
+// map one 2MB megapage, a leaf PTE in a level-1 page-table
+// page. va and pa must be megapage-aligned.
+static int
+mapmega(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if((pagetable = (pde_t*)kalloc_zeroed()) == 0)
+      return -1;
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  pte = &pagetable[PX(1, va)];
+  if(*pte & PTE_V)
+    panic("mapmega: remap");
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  return 0;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// uses 2MB megapages wherever va and pa are both
+// megapage-aligned, and 4KB pages for the rest.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+
+  while(sz > 0){
+#ifndef NOMEGAPAGES
+    if(va % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && sz >= MEGAPGSIZE){
+      if(mapmega(kpgtbl, va, pa, perm) != 0)
+        panic("kvmmap");
+      kvmmega++;
+      n = MEGAPGSIZE;
+    } else
+#endif
+    {
+      // 4KB pages, up to the next megapage boundary.
+      n = MEGAPGSIZE - va % MEGAPGSIZE;
+      if(n > sz)
+        n = sz;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+      kvmsmall += PGROUNDUP(n) / PGSIZE;
+    }
+    va += n;
+    pa += n;
+    sz -= n;
+  }
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -165,22 +329,45 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never mapped (heap pages
+// that were never touched) are skipped. A megapage only
+// partly in the range is split first.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end = va + npages*PGSIZE;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+  for(a = va; a < end; a += PGSIZE){
+    pte_t *l1 = walkl1(pagetable, a);
+    if(l1 && (*l1 & PTE_V) && ISLEAF(*l1)){
+      uint64 base = a - a % MEGAPGSIZE;
+      uint64 pa = PTE2PA(*l1);
+      if(a == base && base + MEGAPGSIZE <= end){
+        if(do_free)
+          free_pages((void*)pa, MEGAORDER);
+        *l1 = 0;
+        a += MEGAPGSIZE - PGSIZE;
+        continue;
+      }
+      // the page at a is being freed: it can hold the
+      // page table for the rest, so splitting needs no memory.
+      if(demote(l1, do_free ? (char*)(pa + a - base) : 0) < 0)
+        panic("uvmunmap: split");
+    }
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
+    if((*pte & PTE_V) == 0){
+      if(*pte & PTE_S){
+        swapfree(*pte);
+        *pte = 0;
+      }
+      continue;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -189,6 +376,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  tlbstale(pagetable);
 }
 
 // create an empty user page table.
@@ -197,10 +385,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -214,8 +401,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -225,6 +411,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
+  struct proc *p = myproc();
   char *mem;
   uint64 a;
 
@@ -233,21 +420,137 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
+    // for exec(): p->pagetable once the new image is committed.
+    if(p)
+      rmapset(mem, p, a);
   }
+  tlbstale(pagetable);
   return newsz;
 }
 
+// Can the current process sleep: does it hold no spinlocks?
+static int
+cansleep(void)
+{
+  push_off();
+  int n = mycpu()->noff;
+  pop_off();
+  return n == 1;
+}
+
+// Read in the pages of [va, va+len) that are swapped out or
+// mmap()ed and not yet read, ahead of a system call that copies
+// to or from them while holding a spinlock (pipes, the console,
+// wait()): uvmlazy() can't read a page in then. They stay
+// pinned until the system call returns: the swapper leaves
+// them be if the process sleeps meanwhile.
+void
+uvmprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  p->pinva = va;
+  p->pinlen = len;
+
+  for(uint64 a = PGROUNDDOWN(va); a < va + len && a < MAXVA; a += PGSIZE){
+    pte = leafpte(p->pagetable, a, 0);
+    if(pte && (*pte & PTE_V))
+      continue;
+    // an untouched heap page is mapped without sleeping.
+    if(a < p->sz && (pte == 0 || (*pte & PTE_S) == 0))
+      continue;
+    if(uvmlazy(p->pagetable, a, 0) == 0)
+      break;
+  }
+}
+
+// Map the page at va on first touch, for uvmlazy().
+static uint64
+lazymap(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  char *mem;
+
+  if(p == 0 || pagetable != p->pagetable)
+    return 0;
+  if(va >= p->sz)
+    return cansleep() ? mmapfault(p, va, write) : 0;
+  va = PGROUNDDOWN(va);
+  if((pte = leafpte(pagetable, va, 0)) != 0 && (*pte & PTE_S))
+    return cansleep() ? swapin(pagetable, va, pte) : 0;
+
+  // a write into a 2MB-aligned stretch of heap that is all
+  // below p->sz and has nothing mapped in it yet gets a
+  // whole megapage, if there is a free 2MB block. not when
+  // memory is short, though: only 4KB pages can be swapped out.
+  uint64 base = va - va % MEGAPGSIZE;
+  pte_t *l1 = walkl1(pagetable, base);
+  if(write && base + MEGAPGSIZE <= p->sz && (l1 == 0 || (*l1 & PTE_V) == 0) &&
+     kfreepages() >= 4 * (MEGAPGSIZE / PGSIZE) &&
+     (mem = alloc_pages(MEGAORDER)) != 0){
+    memset(mem, 0, MEGAPGSIZE);
+    if(mapmega(pagetable, base, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+      free_pages(mem, MEGAORDER);
+      return 0;
+    }
+    // uvmlazy() only flushes va's page.
+    tlbstale(pagetable);
+    __atomic_fetch_add(&vmstat.megaalloc, 1, __ATOMIC_RELAXED);
+    return (uint64)mem + (va - base);
+  }
+
+#ifdef COW
+  if(!write){
+    if(mappages(pagetable, va, PGSIZE, (uint64)zeropage, PTE_R|PTE_U|PTE_CoW) != 0)
+      return 0;
+    krefinc(zeropage);
+    __atomic_fetch_add(&vmstat.zeromap, 1, __ATOMIC_RELAXED);
+    return (uint64)zeropage;
+  }
+#endif
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    kfree(mem);
+    return 0;
+  }
+  rmapset(mem, p, va);
+  __atomic_fetch_add(&vmstat.lazyalloc, 1, __ATOMIC_RELAXED);
+  return (uint64)mem;
+}
+
+// Back the heap page at va on first touch. sbrk() only moves
+// p->sz; pages below it are mapped here, from the page-fault
+// handler or from copyin()/copyout(). A read maps the shared
+// zero page, copy-on-write; a write gets a zeroed page of its
+// own. Above p->sz, mmapfault() reads in mapped file pages,
+// and swapin() reads back pages that were swapped out.
+// Returns the page's physical address, or 0 if va is not in
+// the current process's heap or mappings, memory is exhausted,
+// or the page must be read in and the caller holds a spinlock.
+uint64
+uvmlazy(pagetable_t pagetable, uint64 va, int write)
+{
+  uint64 pa = lazymap(pagetable, va, write);
+
+  // the TLB may still remember the PTE as invalid.
+  if(pa)
+    tlbflush(pagetable, PGROUNDDOWN(va));
+  return pa;
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -311,10 +614,15 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
+    if(uvmsplit(old, i) < 0)
+      goto err;
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;   // never touched; the child allocates its own.
+    if((*pte & PTE_V) == 0){
+      if((*pte & PTE_S) && swapfork(new, i, *pte) < 0)
+        goto err;
+      continue;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
@@ -343,39 +651,120 @@ uvmclear(pagetable_t pagetable, uint64 va)
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
-  *pte &= ~PTE_U;
+  // the kernel itself can reach pages without PTE_U, so that
+  // ucopy() in trampoline.S can copy to and from the kernel
+  // window; leave this one only executable, so it can't.
+  *pte = (*pte & ~(PTE_U|PTE_R|PTE_W)) | PTE_X;
+}
+
+// ucopy() and ucopystr() in trampoline.S, which run at their
+// TRAMPOLINE addresses, since they switch to a user page table.
+extern char ucopy[], ucopystr[];
+
+#define UCOPYOUT 0
+#define UCOPYIN  1
+#define UCOPYSTR 2
+
+// Map the kernel window (KWINDOW) into a new user page table:
+// RAM, with 1GB pages in the top-level page table itself, so it
+// costs no page-table pages, and isn't shared by them either.
+void
+kwinmap(pagetable_t pagetable)
+{
+  for(uint64 pa = KERNBASE; pa < phystop; pa += GIGAPGSIZE)
+    pagetable[PX(2, KWINDOW + pa)] = PA2PTE(pa) | PTE_R | PTE_W | PTE_A | PTE_D | PTE_V;
+}
+
+// Take it out again, before freewalk(), which wants no leaves.
+void
+kwinunmap(pagetable_t pagetable)
+{
+  for(uint64 pa = KERNBASE; pa < phystop; pa += GIGAPGSIZE)
+    pagetable[PX(2, KWINDOW + pa)] = 0;
+}
+
+// Copy n bytes, all in one user page, between the current
+// process's memory at uva and the kernel's at k, in the
+// direction given by how, or (UCOPYSTR) bytes from uva up to
+// and including a NUL, but no more than n. The hardware walks
+// the page table and checks the permissions; a fault, for a
+// page that is copy-on-write, not yet touched, swapped out, or
+// not there at all, ends the copy early. Returns 0, or how many
+// bytes ucopystr() copied (0 if no NUL), or -1 if the caller
+// must copy the slow way.
+static int
+ucopyfast(pagetable_t pagetable, uint64 uva, char *k, uint64 n, int how)
+{
+#ifdef NOUCOPY
+  return -1;
+#else
+  struct proc *p = myproc();
+  uint64 satp, kva = (uint64)k;
+  int r;
+
+  if(p == 0 || pagetable != p->pagetable ||
+     uva >= TRAPFRAME || n > TRAPFRAME - uva ||
+     kva < KERNBASE || kva >= phystop || n > phystop - kva)
+    return -1;
+
+  push_off();
+  // asidsatp() flushes whatever this hart's TLB may hold for
+  // p that is out of date. without ASIDs, switching satp would
+  // need a flush each way, which costs more than it saves.
+  satp = asidsatp(p);
+  if(SATP_ASID(satp) == 0){
+    pop_off();
+    return -1;
+  }
+  if(how == UCOPYSTR)
+    r = ((int (*)(uint64, uint64, uint64, uint64))
+         (TRAMPOLINE + (ucopystr - trampoline)))(kva + KWINDOW, uva, n, satp);
+  else if(how == UCOPYIN)
+    r = ((int (*)(uint64, uint64, uint64, uint64))
+         (TRAMPOLINE + (ucopy - trampoline)))(kva + KWINDOW, uva, n, satp);
+  else
+    r = ((int (*)(uint64, uint64, uint64, uint64))
+         (TRAMPOLINE + (ucopy - trampoline)))(uva, kva + KWINDOW, n, satp);
+  pop_off();
+
+  __atomic_fetch_add(r < 0 ? &vmstat.ucopyslow : &vmstat.ucopyfast, 1, __ATOMIC_RELAXED);
+  return r;
+#endif
 }
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// Each page is copied directly if it can be, or else by finding
+// it in the page table, after making it writable if it is
+// copy-on-write or a file page mapped read-only so far.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
-  // printf("here\n");
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    
-    if(pa0 == 0)
-      return -1;
-pte_t *pte = walk(pagetable, va0, 0);
-  if (pte == 0)
-    return 1;
-  
-  // uint64 pa = PTE2PA(*pte);
-  uint flags = PTE_FLAGS(*pte);
-    if (flags & PTE_CoW)
-    {
-      pagefault(va0, pte, pagetable);
-      pa0 = walkaddr(pagetable, va0);
-    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+
+    if(ucopyfast(pagetable, dstva, src, n, UCOPYOUT) < 0){
+      if((pa0 = walkaddr(pagetable, va0)) == 0)
+        return -1;
+      if((pte = leafpte(pagetable, va0, 0)) == 0)
+        return -1;
+      if(*pte & PTE_CoW){
+        if(pagefault(va0, pte, pagetable) != 0)
+          return -1;
+        pa0 = walkaddr(pagetable, va0);
+      } else if((*pte & PTE_W) == 0){
+        if(mmapwrite(myproc(), va0, pte) != 0)
+          return -1;
+      }
+      memmove((void *)(pa0 + (dstva - va0)), src, n);
+    }
 
     len -= n;
     src += n;
@@ -394,13 +783,16 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+
+    if(ucopyfast(pagetable, srcva, dst, n, UCOPYIN) < 0){
+      pa0 = walkaddr(pagetable, va0);
+      if(pa0 == 0)
+        return -1;
+      memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    }
 
     len -= n;
     dst += n;
@@ -421,13 +813,23 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
 
+    int r = ucopyfast(pagetable, srcva, dst, n, UCOPYSTR);
+    if(r > 0)
+      return 0;
+    if(r == 0){
+      max -= n;
+      dst += n;
+      srcva = va0 + PGSIZE;
+      continue;
+    }
+
+    pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0)
+      return -1;
     char *p = (char *) (pa0 + (srcva - va0));
     while(n > 0){
       if(*p == '\0'){
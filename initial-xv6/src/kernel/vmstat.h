@@ -0,0 +1,28 @@
+// Virtual memory event counters, since boot.
+// vmstat() copies out a struct vmstat.
+
+struct vmstat {
+  uint64 cowcopy;    // COW write faults that copied the page
+  uint64 cowreuse;   // COW write faults that took over a page no one else maps
+  uint64 lazyalloc;  // heap pages allocated on first touch
+  uint64 zeromap;    // untouched heap pages read, and mapped to the zero page
+  uint64 megaalloc;  // 2MB heap megapages allocated on first touch
+  uint64 megasplit;  // megapages split into 4KB pages (fork, partial free)
+  uint64 swapout;    // pages written out to swap
+  uint64 swapin;     // pages read back in from swap
+  uint64 swaptime;   // time CSR ticks spent on those swap-in faults
+  uint64 zramout;    // pages swapped out by compressing them into RAM
+  uint64 zramin;     // pages decompressed back in
+  uint64 zramtime;   // time CSR ticks spent on those faults
+  uint64 zramreject; // pages that didn't compress to half a page
+  uint64 zrampages;  // compressed pages held now
+  uint64 zrambytes;  // RAM the pool holds them in, in whole pages
+  uint64 pcachehit;  // file pages found in the page cache
+  uint64 pcachemiss; // file pages read in from the disk
+  uint64 asidflush;  // one process's TLB entries flushed, on return to user
+  uint64 flushall;   // whole TLBs flushed, for a new ASID generation
+  uint64 asidroll;   // new ASID generations
+  uint64 ucopyfast;  // pages copied to or from user memory directly
+  uint64 ucopyslow;  // pages copied by walking the page table instead
+  uint64 totalpages; // pages of RAM, as the device tree says; for tests
+};
@@ -0,0 +1,73 @@
+//
+// page allocator scaling benchmark.
+//
+// runs 1, 2, 4, ... up to nproc (default 8) processes at once,
+// each repeating an allocation-heavy operation for a fixed
+// number of ticks, and prints the total operations per tick:
+//
+//   sbrk   grow the heap by 16 pages, touch them, shrink it
+//   fork   fork a child that exits at once, and wait for it
+//
+// with one hart's worth of work per process, throughput should
+// grow with the process count up to the number of harts
+// (make qemu CPUS=8).
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define TICKS 30
+#define NPAGES 16
+
+// each op returns uptime(), for benchrun() to stop on.
+int
+op_sbrk(void)
+{
+  char *p = sbrk(NPAGES * 4096);
+
+  if(p == (char*)-1){
+    printf("allocbench: sbrk failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < NPAGES; i++)
+    p[i * 4096] = i;
+  sbrk(-NPAGES * 4096);
+  return uptime();
+}
+
+int
+op_fork(void)
+{
+  int pid = fork();
+
+  if(pid < 0){
+    printf("allocbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  return uptime();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc = 8;
+
+  if(argc > 1)
+    maxproc = atoi(argv[1]);
+  if(maxproc < 1){
+    fprintf(2, "usage: allocbench [nproc]\n");
+    exit(1);
+  }
+
+  printf("procs  sbrk ops/tick  fork ops/tick\n");
+  for(int n = 1; n <= maxproc; n *= 2){
+    int sbrkops = benchrun(op_sbrk, n, TICKS, 0, 0) / TICKS;
+    int forkops = benchrun(op_fork, n, TICKS, 0, 0) / TICKS;
+    printf("%d      %d      %d\n", n, sbrkops, forkops);
+  }
+  exit(0);
+}
@@ -0,0 +1,69 @@
+//
+// a harness for throughput benchmarks (allocbench, lockbench):
+// run an operation in several processes at once, for a fixed
+// number of ticks, and count how many times each did it.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+// run op in nproc processes, all starting on the same tick,
+// until op, which returns uptime(), says ticks have passed.
+// returns the total count of ops, and the least and the most
+// that one process did in *min and *max, if not 0.
+uint
+benchrun(int (*op)(void), int nproc, int ticks, uint *min, uint *max)
+{
+  int fds[2];
+  int start;
+  uint count, total, lo, hi;
+
+  if(pipe(fds) < 0){
+    printf("benchrun: pipe failed\n");
+    exit(1);
+  }
+
+  start = uptime() + 2;
+  for(int i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("benchrun: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      while(uptime() < start)
+        ;
+      count = 0;
+      while(op() < start + ticks)
+        count++;
+      write(fds[1], &count, sizeof(count));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  lo = 0xffffffff;
+  hi = 0;
+  for(int i = 0; i < nproc; i++){
+    if(read(fds[0], &count, sizeof(count)) != sizeof(count)){
+      printf("benchrun: short read\n");
+      exit(1);
+    }
+    total += count;
+    if(count < lo)
+      lo = count;
+    if(count > hi)
+      hi = count;
+  }
+  close(fds[0]);
+  for(int i = 0; i < nproc; i++)
+    wait(0);
+
+  if(min)
+    *min = lo;
+  if(max)
+    *max = hi;
+  return total;
+}
@@ -4,6 +4,7 @@
 
 #include "kernel/types.h"
 #include "kernel/memlayout.h"
+#include "kernel/vmstat.h"
 #include "user/user.h"
 
 // allocate more than half of physical memory,
@@ -177,6 +178,48 @@ filetest()
   printf("ok\n");
 }
 
+// once the child has exited, the parent is the only one
+// left mapping its pages, and writing them should not copy.
+void
+reusetest()
+{
+  struct vmstat before, after;
+  int npages = 32;
+
+  printf("reuse: ");
+
+  char *p = sbrk(npages * 4096);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("sbrk(%d) failed\n", npages * 4096);
+    exit(-1);
+  }
+  for(char *q = p; q < p + npages * 4096; q += 4096)
+    *(int*)q = 1;
+
+  int pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+
+  vmstat(&before);
+  for(char *q = p; q < p + npages * 4096; q += 4096)
+    *(int*)q = 2;
+  vmstat(&after);
+
+  if(after.cowreuse - before.cowreuse < npages){
+    printf("error: %d of %d pages reused\n",
+           (int)(after.cowreuse - before.cowreuse), npages);
+    exit(-1);
+  }
+  sbrk(-npages * 4096);
+
+  printf("ok\n");
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -191,6 +234,8 @@ main(int argc, char *argv[])
 
   filetest();
 
+  reusetest();
+
   printf("ALL COW TESTS PASSED\n");
 
   exit(0);
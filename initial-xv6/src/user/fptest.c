@@ -0,0 +1,94 @@
+//
+// tests for lazy floating-point context switching.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NCHILD 4
+
+// long enough that every child is preempted many times
+// with its running value live in an f register.
+double
+work(double seed)
+{
+  double x = seed;
+
+  for(int i = 0; i < 20000000; i++)
+    x = x * 0.999999 + seed;
+  return x;
+}
+
+// several processes use the FPU at once. any f register
+// state lost or leaked across a context switch changes
+// the result.
+void
+preempttest()
+{
+  double expect[NCHILD];
+  int xstatus;
+
+  printf("preempt: ");
+
+  for(int i = 0; i < NCHILD; i++)
+    expect[i] = work(i + 1);
+
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(-1);
+    }
+    if(pid == 0)
+      exit(work(i + 1) == expect[i] ? 0 : 1);
+  }
+
+  for(int i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("wrong result\n");
+      exit(-1);
+    }
+  }
+
+  printf("ok\n");
+}
+
+// a forked child starts with its parent's f registers,
+// even if the parent never left the CPU since writing them.
+void
+forktest()
+{
+  int xstatus;
+  volatile double d = 3.0;
+  double x = d * 7.0;
+
+  printf("fork: ");
+
+  int pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0)
+    exit(x == 21.0 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0 || x != 21.0){
+    printf("wrong value\n");
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  preempttest();
+  forktest();
+
+  printf("ALL FP TESTS PASSED\n");
+
+  exit(0);
+}
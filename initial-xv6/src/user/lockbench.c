@@ -0,0 +1,73 @@
+//
+// spinlock contention benchmark.
+//
+// nproc processes (default 8) hammer kernel spinlocks through
+// system calls for a fixed number of ticks, and report total
+// throughput and how evenly it was shared between them:
+//
+//   uptime   tickslock
+//   sbrk     kmem.lock, via the page fault's kalloc() and
+//            sbrk(-4096)'s kfree()
+//
+// to compare lock implementations, boot with each of
+//   make qemu CPUS=2|4|8 LOCK=TAS|TICKET
+// and run lockbench.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NPROC 8
+#define TICKS 50
+
+int
+op_uptime()
+{
+  return uptime();
+}
+
+int
+op_sbrk()
+{
+  char *p = sbrk(4096);
+
+  if(p == (char*)-1){
+    printf("lockbench: sbrk failed\n");
+    exit(1);
+  }
+  // sbrk() only moves the break: the write allocates the page.
+  *p = 1;
+  sbrk(-4096);
+  return uptime();
+}
+
+// run op in nproc processes, all starting on the same tick.
+void
+run(char *name, int (*op)(void), int nproc)
+{
+  uint total, min, max;
+
+  total = benchrun(op, nproc, TICKS, &min, &max);
+
+  // fairness: the slowest process's share of the fastest's, in percent.
+  printf("%s: %d procs, %d ops/tick, per proc min %d max %d, fairness %d%%\n",
+         name, nproc, total / TICKS, min, max, max ? (int)((uint64)min * 100 / max) : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = NPROC;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(nproc < 1){
+    fprintf(2, "usage: lockbench [nproc]\n");
+    exit(1);
+  }
+
+  run("uptime", op_uptime, nproc);
+  run("sbrk", op_sbrk, nproc);
+  exit(0);
+}
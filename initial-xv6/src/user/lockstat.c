@@ -0,0 +1,83 @@
+//
+// print the most contended kernel locks.
+//
+//   lockstat            all activity since boot (or the last reset)
+//   lockstat -r         reset the counters
+//   lockstat cmd args   reset, run cmd, then report
+//
+// times are in ticks of the time CSR (10MHz on qemu),
+// for spin and sleep locks alike.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define TOP 12
+
+struct lockstat ls[NLOCKSTAT];
+
+void
+report(void)
+{
+  int n, i, j;
+  struct lockstat t;
+
+  n = lockstat(ls, NLOCKSTAT);
+  if(n < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+
+  // most time spent waiting first.
+  for(i = 0; i < n; i++)
+    for(j = i + 1; j < n; j++)
+      if(ls[j].waittime > ls[i].waittime){
+        t = ls[i];
+        ls[i] = ls[j];
+        ls[j] = t;
+      }
+
+  printf("name             type      acquires   contended        wait time    max hold time\n");
+  for(i = 0; i < n && i < TOP; i++){
+    if(ls[i].acquires == 0)
+      break;
+    printf("%s", ls[i].name);
+    for(j = strlen(ls[i].name); j < 17; j++)
+      printf(" ");
+    printf("%s", ls[i].sleep ? "sleep" : "spin ");
+    printcol(ls[i].acquires, 13);
+    printcol(ls[i].contended, 12);
+    printcol(ls[i].waittime, 17);
+    printcol(ls[i].maxhold, 17);
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    lockstat(0, 0);
+    exit(0);
+  }
+
+  if(argc > 1){
+    lockstat(0, 0);
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  report();
+  exit(0);
+}
@@ -0,0 +1,314 @@
+//
+// tests for mmap() and munmap().
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+#define PAGE 4096
+#define FSIZE (PAGE + PAGE/2)   // one and a half pages
+
+char *file = "mmap.dat";
+char buf[PAGE];
+
+void
+err(char *why)
+{
+  printf("error: %s\n", why);
+  unlink(file);
+  exit(-1);
+}
+
+// write FSIZE bytes of 'A' + (offset / PAGE) to file.
+void
+makefile(void)
+{
+  int fd;
+
+  unlink(file);
+  if((fd = open(file, O_RDWR | O_CREATE)) < 0)
+    err("open");
+  for(int i = 0; i < FSIZE; i += PAGE/2){
+    memset(buf, 'A' + i / PAGE, PAGE/2);
+    if(write(fd, buf, PAGE/2) != PAGE/2)
+      err("write");
+  }
+  close(fd);
+}
+
+// p should hold the file's contents, then zeros to the
+// end of the page.
+void
+checkfile(char *p)
+{
+  for(int i = 0; i < FSIZE; i++)
+    if(p[i] != 'A' + i / PAGE)
+      err("wrong content");
+  for(int i = FSIZE; i < 2*PAGE; i++)
+    if(p[i] != 0)
+      err("not zero past end of file");
+}
+
+void
+privatetest(void)
+{
+  int fd;
+  char *p;
+
+  printf("private: ");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    err("open");
+  p = mmap(0, 2*PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+  checkfile(p);
+
+  // writes stay in the process.
+  p[0] = 'Z';
+  if(munmap(p, 2*PAGE) < 0)
+    err("munmap");
+  if((fd = open(file, O_RDONLY)) < 0)
+    err("open");
+  if(read(fd, buf, 1) != 1 || buf[0] != 'A')
+    err("private write reached the file");
+  close(fd);
+  printf("ok\n");
+}
+
+void
+sharedtest(void)
+{
+  int fd;
+  char *p;
+
+  printf("shared: ");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    err("open");
+  p = mmap(0, 2*PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+
+  // a read-only file can't be mapped shared and writable.
+  int rfd = open(file, O_RDONLY);
+  if(mmap(0, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, rfd, 0) != (char*)-1)
+    err("writable mapping of a read-only file");
+  close(rfd);
+
+  // write the second page, and past the end of the file.
+  p[PAGE] = 'Y';
+  p[FSIZE + 1] = 'Y';
+  // and read() the file into the first page of its own mapping.
+  if(read(fd, p, 10) != 10)
+    err("read into mapping");
+  if(munmap(p, 2*PAGE) < 0)
+    err("munmap");
+  close(fd);
+
+  if((fd = open(file, O_RDONLY)) < 0)
+    err("open");
+  if(read(fd, buf, PAGE) != PAGE || buf[0] != 'A')
+    err("wrong first page");
+  if(read(fd, buf, PAGE) != PAGE/2 || buf[0] != 'Y')
+    err("write not written back");
+  close(fd);
+  printf("ok\n");
+}
+
+// unmapping part of a mapping leaves the rest.
+void
+partialtest(void)
+{
+  int fd;
+  char *p;
+
+  printf("partial: ");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    err("open");
+  p = mmap(0, 2*PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+
+  p[0] = 'X';
+  p[PAGE] = 'X';
+  if(munmap(p + PAGE/2, PAGE) == 0)
+    err("munmap of the middle");
+  if(munmap(p, PAGE) < 0)
+    err("munmap of the first page");
+  if(p[PAGE] != 'X')
+    err("second page lost");
+  if(munmap(p + PAGE, PAGE) < 0)
+    err("munmap of the second page");
+
+  if((fd = open(file, O_RDONLY)) < 0)
+    err("open");
+  if(read(fd, buf, PAGE) != PAGE || buf[0] != 'X')
+    err("first page not written back");
+  if(read(fd, buf, PAGE) != PAGE/2 || buf[0] != 'X')
+    err("second page not written back");
+  close(fd);
+  printf("ok\n");
+}
+
+// a child shares MAP_SHARED pages with its parent, whether
+// they were touched before the fork or only after it, and gets
+// its own copy of MAP_PRIVATE ones it writes.
+void
+forktest(void)
+{
+  int fd, pid, xstatus, go[2], done[2];
+  char *s, *q, c;
+
+  printf("fork: ");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    err("open");
+  s = mmap(0, 2*PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(s == (char*)-1 || q == (char*)-1)
+    err("mmap");
+  close(fd);
+  if(pipe(go) < 0 || pipe(done) < 0)
+    err("pipe");
+
+  // read in the first page of each before the fork; the
+  // second page of s is first touched by both afterwards.
+  if(s[0] != 'A' || q[0] != 'A')
+    err("wrong content");
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    if(read(go[0], &c, 1) != 1)
+      exit(1);
+    s[1] = 'C';
+    s[PAGE + 1] = 'C';
+    q[2] = 'C';
+    write(done[1], "x", 1);
+    // wait, so that the parent sees the writes through
+    // the pages themselves, not after write-back at exit.
+    read(go[0], &c, 1);
+    exit(0);
+  }
+  if(s[PAGE] != 'B')
+    err("wrong content");
+  write(go[1], "x", 1);
+  if(read(done[0], &c, 1) != 1)
+    err("child failed");
+  if(s[1] != 'C')
+    err("child's shared write not seen");
+  if(s[PAGE + 1] != 'C')
+    err("child's shared write to a page touched after fork not seen");
+  if(q[2] != 'A')
+    err("child's private write seen");
+  write(go[1], "x", 1);
+  wait(&xstatus);
+  if(xstatus != 0)
+    err("child failed");
+  close(go[0]);
+  close(go[1]);
+  close(done[0]);
+  close(done[1]);
+  if(munmap(s, 2*PAGE) < 0 || munmap(q, PAGE) < 0)
+    err("munmap");
+  printf("ok\n");
+}
+
+// read(), write() and mappings all see the same page, and
+// reading a file again finds it in the page cache.
+void
+coherencetest(void)
+{
+  struct vmstat before, after;
+  int fd;
+  char *p;
+
+  printf("coherence: ");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    err("open");
+  p = mmap(0, 2*PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+
+  // a store through the mapping, before any write-back.
+  p[3] = 'M';
+  if(read(fd, buf, 4) != 4 || buf[3] != 'M')
+    err("read() doesn't see the mapping's write");
+  // and a write() into a page already mapped.
+  if(write(fd, "W", 1) != 1 || p[4] != 'W')
+    err("mapping doesn't see write()");
+  if(munmap(p, 2*PAGE) < 0)
+    err("munmap");
+  close(fd);
+
+  vmstat(&before);
+  if((fd = open(file, O_RDONLY)) < 0)
+    err("open");
+  if(read(fd, buf, PAGE) != PAGE || buf[3] != 'M' || buf[4] != 'W')
+    err("wrong content");
+  close(fd);
+  vmstat(&after);
+  if(after.pcachehit == before.pcachehit)
+    err("not found in the page cache");
+  printf("ok\n");
+}
+
+// touching an unmapped page kills the process.
+void
+unmappedtest(void)
+{
+  int fd, pid, xstatus;
+  char *p;
+
+  printf("unmapped: ");
+  makefile();
+  if((fd = open(file, O_RDONLY)) < 0)
+    err("open");
+  p = mmap(0, PAGE, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    p[0] = 'W';   // read-only
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1)
+    err("write to a read-only mapping");
+
+  if(munmap(p, PAGE) < 0)
+    err("munmap");
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0)
+    exit(p[0]);
+  wait(&xstatus);
+  if(xstatus != -1)
+    err("read of an unmapped page");
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  privatetest();
+  sharedtest();
+  partialtest();
+  forktest();
+  coherencetest();
+  unmappedtest();
+  unlink(file);
+
+  printf("ALL MMAP TESTS PASSED\n");
+
+  exit(0);
+}
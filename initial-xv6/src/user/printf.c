@@ -111,3 +111,22 @@ printf(const char *fmt, ...)
   va_start(ap, fmt);
   vprintf(1, fmt, ap);
 }
+
+// print x in decimal, right-aligned in a field of width w,
+// for tables of 64-bit counters: printf's %l only handles
+// 32 bits.
+void
+printcol(uint64 x, int w)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do{
+    buf[--i] = '0' + x % 10;
+    x /= 10;
+  }while(x != 0 && i > 0);
+  for(int n = sizeof(buf) - 1 - i; n < w; n++)
+    putc(1, ' ');
+  printf("%s", buf + i);
+}
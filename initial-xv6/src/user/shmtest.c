@@ -0,0 +1,196 @@
+//
+// tests for shared-memory segments.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define PAGE 4096
+#define SIZE (16 * PAGE)
+
+void
+err(char *why)
+{
+  printf("error: %s\n", why);
+  exit(-1);
+}
+
+// a child attaches the segment by key, fills it, and the
+// parent sees every byte through its own attachment.
+void
+sharetest(void)
+{
+  int id, pid, xstatus;
+  char *p;
+
+  printf("share: ");
+  if((id = shm_open(1, SIZE)) < 0)
+    err("shm_open");
+  if((p = shm_attach(id)) == (char*)-1)
+    err("shm_attach");
+
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    char *q;
+    if(shm_open(1, SIZE) != id)
+      err("shm_open found another segment");
+    if((q = shm_attach(id)) == (char*)-1 || q == p)
+      err("shm_attach in child");
+    for(int i = 0; i < SIZE; i++)
+      q[i] = i % 251;
+    if(shm_detach(q) < 0)
+      err("shm_detach");
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(-1);
+  for(int i = 0; i < SIZE; i++)
+    if(p[i] != (char)(i % 251))
+      err("wrong content");
+  if(shm_detach(p) < 0)
+    err("shm_detach");
+  shm_close(id);
+  printf("ok\n");
+}
+
+// an attachment survives fork(), and the child writes to the
+// same pages.
+void
+forktest(void)
+{
+  int id, pid, xstatus;
+  char *p;
+
+  printf("fork: ");
+  if((id = shm_open(2, PAGE)) < 0 || (p = shm_attach(id)) == (char*)-1)
+    err("shm_open or shm_attach");
+  p[0] = 'a';
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    p[0] = 'b';
+    p[1] = 'c';
+    p[PAGE-1] = 'd';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[0] != 'b' || p[1] != 'c' || p[PAGE-1] != 'd')
+    err("child's writes not seen");
+  shm_detach(p);
+  shm_close(id);
+  printf("ok\n");
+}
+
+// a segment goes away with its last open and attachment.
+void
+freetest(void)
+{
+  int id;
+  char *p;
+
+  printf("free: ");
+  if((id = shm_open(3, PAGE)) < 0 || (p = shm_attach(id)) == (char*)-1)
+    err("shm_open or shm_attach");
+  p[0] = 'x';
+  if(shm_open(3, 2 * PAGE) != -1)
+    err("opened a larger segment than exists");
+  if(shm_detach(p + 1) != -1)
+    err("detached at the wrong address");
+  if(shm_detach(p) < 0)
+    err("shm_detach");
+  if(shm_detach(p) != -1)
+    err("detached twice");
+  if(shm_close(id) < 0)
+    err("shm_close");
+  if(shm_close(id) != -1)
+    err("closed twice");
+
+  if((id = shm_open(3, PAGE)) < 0 || (p = shm_attach(id)) == (char*)-1)
+    err("shm_open or shm_attach");
+  if(p[0] != 0)
+    err("old segment not freed");
+  shm_detach(p);
+  shm_close(id);
+  printf("ok\n");
+}
+
+// segments opened and never attached go away with shm_close(),
+// or with the process, instead of filling the table.
+void
+closetest(void)
+{
+  int id, pid, xstatus;
+
+  printf("close: ");
+  for(int i = 0; i < 2 * NSHM; i++){
+    if((id = shm_open(100 + i, PAGE)) < 0)
+      err("shm_open");
+    if(shm_close(id) < 0)
+      err("shm_close");
+  }
+
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    for(int i = 0; i < NSHM; i++)
+      if(shm_open(200 + i, PAGE) < 0)
+        err("shm_open in child");
+    if(shm_open(200 + NSHM, PAGE) != -1)
+      err("more segments than slots");
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(-1);
+  for(int i = 0; i < NSHM; i++){
+    if((id = shm_open(300 + i, PAGE)) < 0)
+      err("exit left segments open");
+    shm_close(id);
+  }
+  printf("ok\n");
+}
+
+// a failed shm_attach() doesn't free a segment that is open
+// but has no other attachment.
+void
+attachfailtest(void)
+{
+  int id, other;
+  char *p, *q[NVMA];
+
+  printf("attach fail: ");
+  if((id = shm_open(4, PAGE)) < 0 || (other = shm_open(5, PAGE)) < 0)
+    err("shm_open");
+  for(int i = 0; i < NVMA; i++)
+    if((q[i] = shm_attach(other)) == (char*)-1)
+      err("shm_attach");
+  if(shm_attach(id) != (char*)-1)
+    err("attached past NVMA regions");
+  for(int i = 0; i < NVMA; i++)
+    shm_detach(q[i]);
+
+  if((p = shm_attach(id)) == (char*)-1)
+    err("segment freed by the failed attach");
+  p[0] = 'z';
+  shm_detach(p);
+  shm_close(id);
+  shm_close(other);
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  sharetest();
+  forktest();
+  freetest();
+  closetest();
+  attachfailtest();
+
+  printf("ALL SHM TESTS PASSED\n");
+
+  exit(0);
+}
@@ -0,0 +1,127 @@
+//
+// tests for swapping: use more memory than the machine has.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+#define PAGE 4096
+
+// the words of page i: random ones, which don't compress,
+// or just i then zeros, which do.
+uint64
+word(uint64 i, int j, int random)
+{
+  uint64 x = i * 4096 + j + 1;
+
+  if(!random)
+    return j == 0 ? i : 0;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+void
+fill(char *p, uint64 i, int random)
+{
+  uint64 *w = (uint64*)p;
+
+  for(int j = 0; j < PAGE / 8; j++)
+    w[j] = word(i, j, random);
+}
+
+int
+check(char *p, uint64 i, int random)
+{
+  uint64 *w = (uint64*)p;
+
+  for(int j = 0; j < PAGE / 8; j++)
+    if(w[j] != word(i, j, random))
+      return 0;
+  return 1;
+}
+
+// fill every page of a heap larger than physical memory (but
+// not by more than the swap area can take), and
+// check them all, in the process that wrote them and in a child
+// that shares them. random pages must go to the disk; others
+// may be kept compressed in RAM.
+void
+bigtest(int random)
+{
+  struct vmstat before, after;
+  uint64 sz, extra;
+  int pid, xstatus;
+
+  printf("big %s: ", random ? "random" : "sparse");
+  vmstat(&before);
+  sz = before.totalpages * PAGE;
+  extra = (uint64)SWAPSIZE * BSIZE / 4;
+  sz += sz / 8 < extra ? sz / 8 : extra;
+  char *p = sbrk(sz);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("sbrk(%d) failed\n", (int)sz);
+    exit(-1);
+  }
+
+  for(uint64 i = 0; i < sz / PAGE; i++)
+    fill(p + i * PAGE, i, random);
+  for(uint64 i = 0; i < sz / PAGE; i++){
+    if(!check(p + i * PAGE, i, random)){
+      printf("wrong content\n");
+      exit(-1);
+    }
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0){
+    for(uint64 i = 0; i < sz / PAGE; i++){
+      if(!check(p + i * PAGE, i, random)){
+        printf("wrong content in child\n");
+        exit(-1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(-1);
+
+  vmstat(&after);
+  if(random && after.swapout == before.swapout){
+    printf("nothing was swapped to disk\n");
+    exit(-1);
+  }
+  if(after.swapout + after.zramout == before.swapout + before.zramout){
+    printf("nothing was swapped\n");
+    exit(-1);
+  }
+  if(sbrk(-sz) == (char*)0xffffffffffffffffL){
+    printf("sbrk(-%d) failed\n", (int)sz);
+    exit(-1);
+  }
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  bigtest(0);
+  bigtest(1);
+
+  // check that the first bigtest()s freed their swap slots.
+  bigtest(0);
+  bigtest(1);
+
+  printf("ALL SWAP TESTS PASSED\n");
+
+  exit(0);
+}
@@ -0,0 +1,174 @@
+//
+// TLB pressure benchmark.
+//
+// the kernel reaches user memory through its direct map of
+// RAM, so system calls that copy to or from many different
+// user pages touch many different kernel pages too:
+//
+//   pipe   stream a large buffer through a pipe to a child,
+//          which reads it into a large buffer of its own
+//   cow    fork, and have the child write every page of a
+//          large heap, copying each one
+//
+// and every trap and context switch may cost a process the
+// TLB entries for its working set:
+//
+//   switch two processes pass a byte back and forth through
+//          pipes, touching a few pages of their own each time
+//
+// to compare the kernel direct map with and without 2MB
+// megapages, processes with and without ASIDs, or copyin()
+// and copyout() with and without direct access to user memory
+// (pipe), boot with each of
+//   make qemu MEGAPAGES=1|0
+//   make qemu ASID=1|0
+//   make qemu UCOPY=1|0
+// and run tlbbench.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define PAGE 4096
+#define NPAGES 1024   // 4MB
+#define ROUNDS 8
+#define CHUNK 512     // pipe write size, the pipe's capacity
+#define SWITCHES 20000
+#define NTOUCH 32     // pages each side touches per switch
+
+char *buf;
+
+int
+bench_pipe(void)
+{
+  int fds[2];
+  int t0;
+
+  if(pipe(fds) < 0){
+    printf("tlbbench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    printf("tlbbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // read page by page, striding across the buffer.
+    close(fds[1]);
+    for(int r = 0; r < ROUNDS; r++)
+      for(int off = 0; off < PAGE; off += CHUNK)
+        for(int i = 0; i < NPAGES; i++)
+          if(read(fds[0], buf + i * PAGE + off, CHUNK) != CHUNK){
+            printf("tlbbench: short read\n");
+            exit(1);
+          }
+    exit(0);
+  }
+
+  close(fds[0]);
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    for(int off = 0; off < PAGE; off += CHUNK)
+      for(int i = 0; i < NPAGES; i++)
+        if(write(fds[1], buf + i * PAGE + off, CHUNK) != CHUNK){
+          printf("tlbbench: short write\n");
+          exit(1);
+        }
+  close(fds[1]);
+  wait(0);
+  return uptime() - t0;
+}
+
+int
+bench_cow(void)
+{
+  int t0 = uptime();
+
+  for(int r = 0; r < ROUNDS; r++){
+    int pid = fork();
+    if(pid < 0){
+      printf("tlbbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(int i = 0; i < NPAGES; i++)
+        buf[i * PAGE] = r;
+      exit(0);
+    }
+    wait(0);
+  }
+  return uptime() - t0;
+}
+
+// touch NTOUCH pages of buf, from page first on.
+void
+touch(int first)
+{
+  for(int i = 0; i < NTOUCH; i++)
+    buf[(first + i) * PAGE]++;
+}
+
+int
+bench_switch(void)
+{
+  int ping[2], pong[2];
+  char c = 0;
+  int t0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("tlbbench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    printf("tlbbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(int r = 0; r < SWITCHES; r++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1){
+        printf("tlbbench: switch failed\n");
+        exit(1);
+      }
+      touch(NTOUCH);
+    }
+    exit(0);
+  }
+
+  t0 = uptime();
+  for(int r = 0; r < SWITCHES; r++){
+    touch(0);
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("tlbbench: switch failed\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  t0 = uptime() - t0;
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  return t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  buf = sbrk(NPAGES * PAGE);
+  if(buf == (char*)-1){
+    printf("tlbbench: sbrk failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < NPAGES; i++)
+    buf[i * PAGE] = 1;
+
+  printf("%d rounds over %d pages, in ticks:\n", ROUNDS, NPAGES);
+  printf("  pipe  %d\n", bench_pipe());
+  printf("  cow   %d\n", bench_cow());
+  printf("%d round trips, touching %d pages each:\n", SWITCHES, NTOUCH);
+  printf("  switch %d\n", bench_switch());
+  exit(0);
+}
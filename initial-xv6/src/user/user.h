@@ -1,4 +1,6 @@
 struct stat;
+struct lockstat;
+struct vmstat;
 
 // system calls
 int fork(void);
@@ -25,6 +27,14 @@ int uptime(void);
 int waitx(int*, int* /*wtime*/, int* /*rtime*/);
 int getreadcount(void);
 int set_priority(int,int);
+int lockstat(struct lockstat*, int);
+int vmstat(struct vmstat*);
+void *mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int shm_open(int, int);
+void *shm_attach(int);
+int shm_detach(void*);
+int shm_close(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -34,6 +44,7 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+void printcol(uint64, int);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
@@ -42,3 +53,12 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// bench.c
+uint benchrun(int (*)(void), int, int, uint*, uint*);
+
+// uvec.S: vector (RVV) versions of string routines.
+void *vmemcpy(void*, const void*, uint);
+void *vmemset(void*, int, uint);
+uint vstrlen(const char*);
+uint vchecksum(const void*, uint);
@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/vmstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2217,11 +2218,13 @@ sbrkfail(char *s)
   if(pid == 0){
     // allocate a lot of memory.
     // this should produce a page fault,
-    // and thus not complete.
+    // and thus not complete. write each page: reading
+    // untouched heap only maps the shared zero page.
     a = sbrk(0);
     sbrk(10*BIG);
     int n = 0;
     for (i = 0; i < 10*BIG; i += PGSIZE) {
+      *(a+i) = 1;
       n += *(a+i);
     }
     // print n so the compiler doesn't optimize away
@@ -2554,6 +2557,116 @@ sbrk8000(char *s)
   *(top-1) = *(top-1) + 1;
 }
 
+// sbrk() a large region and touch only a little of it, from
+// user space and from the kernel (read() into it, write() out
+// of it). pages that were never written must read as zero,
+// and pages that were only read must still be writable.
+void
+sbrklazy(char *s)
+{
+  enum { BIG=256*1024*1024 };
+  char *a = sbrk(BIG);
+  int fds[2];
+
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%d) failed\n", s, BIG);
+    exit(1);
+  }
+  for(char *q = a; q < a + BIG; q += BIG/16)
+    *q = 'x';
+  if(a[BIG - 1] != 0 || a[BIG/32] != 0){
+    printf("%s: untouched page not zero\n", s);
+    exit(1);
+  }
+  // a write to a page that so far has only been read.
+  a[BIG/32] = 'y';
+  if(a[BIG/32] != 'y' || a[BIG/32 + 1] != 0 || a[BIG/16 + BIG/32] != 0){
+    printf("%s: write after read failed\n", s);
+    exit(1);
+  }
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], a + BIG/2, 2) != 2 || read(fds[0], a + BIG/8 + 4096, 2) != 2){
+    printf("%s: pipe i/o through lazy pages failed\n", s);
+    exit(1);
+  }
+  if(a[BIG/8 + 4096] != 'x' || a[BIG/8 + 4097] != 0){
+    printf("%s: wrong data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-BIG);
+}
+
+// a heap big enough to be backed by 2MB megapages (at least
+// one of which it must get): shrinking it to the middle of a megapage must keep the part below,
+// the data must survive a fork (which splits megapages), and
+// writes in the child must not show up in the parent.
+void
+sbrkmega(char *s)
+{
+  enum { MB=1024*1024 };
+  char *a, *p;
+  int xstatus;
+  struct vmstat before, after;
+
+  // start at a 2MB boundary.
+  a = sbrk(0);
+  sbrk((2*MB - (uint64)a % (2*MB)) % (2*MB));
+  a = sbrk(6*MB);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  vmstat(&before);
+  for(p = a; p < a + 6*MB; p += 4096)
+    *(int*)p = (p - a) / 4096;
+  vmstat(&after);
+  if(after.megaalloc == before.megaalloc){
+    printf("%s: no megapage allocated\n", s);
+    exit(1);
+  }
+
+  sbrk(-MB);
+  for(p = a; p < a + 5*MB; p += 4096){
+    if(*(int*)p != (p - a) / 4096){
+      printf("%s: shrinking lost data\n", s);
+      exit(1);
+    }
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + 5*MB; p += 4096){
+      if(*(int*)p != (p - a) / 4096){
+        printf("%s: child read wrong data\n", s);
+        exit(1);
+      }
+      *(int*)p = -1;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  for(p = a; p < a + 5*MB; p += 4096){
+    if(*(int*)p != (p - a) / 4096){
+      printf("%s: child's writes seen by parent\n", s);
+      exit(1);
+    }
+  }
+  sbrk(-5*MB);
+}
+
 
 
 // regression test. test whether exec() leaks memory if one of the
@@ -2634,6 +2747,8 @@ struct test {
   {sbrkbugs, "sbrkbugs" },
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
+  {sbrklazy, "sbrklazy"},
+  {sbrkmega, "sbrkmega"},
   {badarg, "badarg" },
 
   { 0, 0},
@@ -38,4 +38,12 @@ entry("sleep");
 entry("uptime");
 entry("waitx");
 entry("getreadcount");
-entry("set_priority");
\ No newline at end of file
+entry("set_priority");
+entry("lockstat");
+entry("vmstat");
+entry("mmap");
+entry("munmap");
+entry("shm_open");
+entry("shm_attach");
+entry("shm_detach");
+entry("shm_close");
\ No newline at end of file
@@ -0,0 +1,178 @@
+//
+// compare the vector (RVV) string routines in uvec.S with
+// the scalar ones in ulib.c, and check that vector state
+// survives context switches.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define BUFSZ (64*1024)
+#define ROUNDS 200
+#define NCHILD 4
+
+char src[BUFSZ];
+char dst[BUFSZ];
+
+uint
+checksum(const void *buf, uint n)
+{
+  const uchar *p = buf;
+  uint sum = 0;
+
+  while(n-- > 0)
+    sum += *p++;
+  return sum;
+}
+
+void
+fill(char *buf, int seed)
+{
+  for(int i = 0; i < BUFSZ; i++)
+    buf[i] = (i * 7 + seed) % 251 + 1;   // never zero
+}
+
+void
+correct()
+{
+  printf("correctness: ");
+
+  fill(src, 3);
+  for(int n = 0; n < 300; n++){
+    memset(dst, 0, BUFSZ);
+    vmemcpy(dst + 1, src + n, n);
+    if(memcmp(dst + 1, src + n, n) != 0 || dst[0] != 0 || dst[n + 1] != 0){
+      printf("vmemcpy wrong at n=%d\n", n);
+      exit(-1);
+    }
+    vmemset(dst + 1, 'x', n);
+    for(int i = 1; i <= n; i++)
+      if(dst[i] != 'x'){
+        printf("vmemset wrong at n=%d\n", n);
+        exit(-1);
+      }
+    if(dst[n + 1] != 0){
+      printf("vmemset overran at n=%d\n", n);
+      exit(-1);
+    }
+    if(vchecksum(src + n, n) != checksum(src + n, n)){
+      printf("vchecksum wrong at n=%d\n", n);
+      exit(-1);
+    }
+    dst[n + 1] = 0;
+    if(vstrlen(dst + 1) != n){
+      printf("vstrlen wrong at n=%d\n", n);
+      exit(-1);
+    }
+  }
+
+  printf("ok\n");
+}
+
+// several processes hold different data in their v registers
+// at once; anything lost or leaked across a context switch
+// shows up as a wrong checksum.
+void
+preempt()
+{
+  int xstatus;
+
+  printf("preempt: ");
+
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(-1);
+    }
+    if(pid == 0){
+      fill(src, i);
+      uint expect = checksum(src, BUFSZ);
+      for(int r = 0; r < ROUNDS; r++){
+        vmemcpy(dst, src, BUFSZ);
+        if(vchecksum(dst, BUFSZ) != expect)
+          exit(1);
+      }
+      exit(0);
+    }
+  }
+
+  for(int i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("wrong result\n");
+      exit(-1);
+    }
+  }
+
+  printf("ok\n");
+}
+
+void
+bench()
+{
+  int t0, scalar, vector;
+  uint sum = 0;
+
+  fill(src, 0);
+  src[BUFSZ - 1] = 0;
+
+  printf("%d rounds over %d bytes, in ticks (scalar / vector):\n", ROUNDS, BUFSZ);
+
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    memmove(dst, src, BUFSZ);
+  scalar = uptime() - t0;
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    vmemcpy(dst, src, BUFSZ);
+  vector = uptime() - t0;
+  printf("  memcpy    %d / %d\n", scalar, vector);
+
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    memset(dst, r, BUFSZ);
+  scalar = uptime() - t0;
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    vmemset(dst, r, BUFSZ);
+  vector = uptime() - t0;
+  printf("  memset    %d / %d\n", scalar, vector);
+
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    sum += strlen(src);
+  scalar = uptime() - t0;
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    sum += vstrlen(src);
+  vector = uptime() - t0;
+  printf("  strlen    %d / %d\n", scalar, vector);
+
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    sum += checksum(src, BUFSZ);
+  scalar = uptime() - t0;
+  t0 = uptime();
+  for(int r = 0; r < ROUNDS; r++)
+    sum += vchecksum(src, BUFSZ);
+  vector = uptime() - t0;
+  printf("  checksum  %d / %d\n", scalar, vector);
+
+  // keep the compiler from dropping the scalar loops.
+  if(sum == 1)
+    printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  correct();
+  preempt();
+  bench();
+
+  printf("ALL VECTOR TESTS PASSED\n");
+
+  exit(0);
+}
@@ -0,0 +1,85 @@
+//
+// print the kernel's virtual memory counters.
+//
+//   vmstat            totals since boot
+//   vmstat cmd args   run cmd, then print what it added
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+void
+row(char *name, uint64 x)
+{
+  printf("%s", name);
+  for(int j = strlen(name); j < 12; j++)
+    printf(" ");
+  printcol(x, 12);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat before, after;
+
+  memset(&before, 0, sizeof(before));
+  if(argc > 1){
+    if(vmstat(&before) < 0){
+      fprintf(2, "vmstat: failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "vmstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "vmstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(vmstat(&after) < 0){
+    fprintf(2, "vmstat: failed\n");
+    exit(1);
+  }
+
+  row("cow copy", after.cowcopy - before.cowcopy);
+  row("cow reuse", after.cowreuse - before.cowreuse);
+  row("lazy alloc", after.lazyalloc - before.lazyalloc);
+  row("zero map", after.zeromap - before.zeromap);
+  row("mega alloc", after.megaalloc - before.megaalloc);
+  row("mega split", after.megasplit - before.megasplit);
+  row("swap out", after.swapout - before.swapout);
+  row("swap in", after.swapin - before.swapin);
+  row("zram out", after.zramout - before.zramout);
+  row("zram in", after.zramin - before.zramin);
+  row("zram reject", after.zramreject - before.zramreject);
+  row("pcache hit", after.pcachehit - before.pcachehit);
+  row("pcache miss", after.pcachemiss - before.pcachemiss);
+  row("asid flush", after.asidflush - before.asidflush);
+  row("flush all", after.flushall - before.flushall);
+  row("asid roll", after.asidroll - before.asidroll);
+  row("ucopy fast", after.ucopyfast - before.ucopyfast);
+  row("ucopy slow", after.ucopyslow - before.ucopyslow);
+
+  // the RAM there is, what the compressed pool holds now,
+  // and the average cost of a fault that reads a page back
+  // in, in ticks of the time CSR (10MHz on qemu).
+  row("total pages", after.totalpages);
+  row("zram pages", after.zrampages);
+  row("zram bytes", after.zrambytes);
+  if(after.zrambytes){
+    uint64 r = after.zrampages * 4096 * 10 / after.zrambytes;
+    printf("zram ratio  %d.%d : 1\n", (int)(r / 10), (int)(r % 10));
+  }
+  if(after.swapin > before.swapin)
+    row("swapin time", (after.swaptime - before.swaptime) / (after.swapin - before.swapin));
+  if(after.zramin > before.zramin)
+    row("zramin time", (after.zramtime - before.zramtime) / (after.zramin - before.zramin));
+  exit(0);
+}